@@ -5,11 +5,14 @@
 #include <vector>
 #include <string>
 #include <fstream>
+#include <iterator>
+#include <algorithm>
 
 #include <assert.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
+#include <string.h>
 
 #include <sys/stat.h>
 
@@ -73,6 +76,37 @@ static void split(const string &query,vector<string> &item_list,char sep=' ')
 	}
 }
 
+/*
+ * feeds the unigrams to the trie builder in key order and numbers them in
+ * that order, so that the id of a term is the rank of its key in the trie
+ * (see getTerm); sorted_ids maps the id in the model file to the new one
+ */
+template <typename Sorter>
+struct TermRanker {
+	Sorter &sorter;
+	vector<uint32_t> &sorted_ids;
+	uint32_t first_id;
+	uint32_t next_id;
+
+	bool next(string &key,uint32_t &value)
+	{
+		uint32_t file_id;
+		if (!sorter.next(key,file_id))
+			return false;
+		sorted_ids[file_id - first_id] = next_id;
+		value = next_id++;
+		return true;
+	}
+	size_t size() const { return sorter.size(); }
+	const double *frequencies() const { return sorter.frequencies(); }
+};
+
+template <typename Gram>
+static bool lessById(const Gram &a,const Gram &b)
+{
+	return a.id < b.id;
+}
+
 static inline void updateGramTermFreq(DataMap &dict,const string &key,
 		const struct GramTerm &term)
 {
@@ -195,30 +229,35 @@ LanguageModel::LanguageModel()
 	_tri_buf = NULL;
 }
 
-LanguageModel::~LanguageModel()
+inline void LanguageModel::release()
 {
+#ifdef DASTRIE_HAS_MMAP
+	/* the buffers of a shared index belong to the image */
+	if (_image.attached()) {
+		_trie.close();
+		_image.detach();
+		_uni_buf = NULL;
+		_bi_buf = NULL;
+		_tri_buf = NULL;
+	}
+#endif
 	if (_uni_buf != NULL) {
 		delete[] _uni_buf;
+		_uni_buf = NULL;
 	}
 	if (_bi_buf != NULL) {
 		delete[] _bi_buf;
+		_bi_buf = NULL;
 	}
 	if (_tri_buf != NULL) {
 		delete[] _tri_buf;
+		_tri_buf = NULL;
 	}
 }
 
-inline void LanguageModel::release()
+LanguageModel::~LanguageModel()
 {
-	if (_uni_buf != NULL) {
-		delete[] _uni_buf;
-	}
-	if (_bi_buf != NULL) {
-		delete[] _bi_buf;
-	}
-	if (_tri_buf != NULL) {
-		delete[] _tri_buf;
-	}
+	release();
 }
 
 int LanguageModel::train(
@@ -636,7 +675,9 @@ int LanguageModel::build(const char *model_file,const char *index_file)
 
 	/* еunigramȷеterm id,overflow */
 	uint32_t term_id = _oov_id;
-	vector<DARecord> term_id_list;
+	/* unigrams are sorted on disk by term for the trie, which renumbers
+	 * them in key order below */
+	DASorter term_id_list;
 	map<string,uint32_t> term_id_map;
 
 	uint64_t total_bigram_count = 0;
@@ -653,14 +694,11 @@ int LanguageModel::build(const char *model_file,const char *index_file)
 		}
 		const string &phrase = field_list[0];
 
-		DARecord record;
 		vector<string> term_list;
 		split(phrase,term_list,' ');
 		switch (term_list.size()) {
 		case 1:
-			record.key = phrase;
-			record.value = term_id;
-			term_id_list.push_back(record);
+			term_id_list.append(phrase,term_id);
 			term_id_map[phrase] = term_id; 
 			DLOG("insert term <%s> with id <%u>\n",phrase.c_str(),term_id);
 			++term_id;
@@ -685,6 +723,17 @@ int LanguageModel::build(const char *model_file,const char *index_file)
 		exit(EXIT_FAILURE);
 	}
 
+	/* build term da, numbering the terms in key order */
+	vector<uint32_t> sorted_ids(term_id - _oov_id);
+	TermRanker<DASorter> ranker = {term_id_list,sorted_ids,_oov_id,_oov_id};
+	DABuilder builder;
+	builder.build_stream(ranker);
+	/* parent links for reverse lookups of term ids */
+	builder.annotate_keys();
+	for (map<string,uint32_t>::iterator it = term_id_map.begin();
+			it != term_id_map.end();++it)
+		it->second = sorted_ids[it->second - _oov_id];
+
 	/* gram */
 	vector<struct Unigram> unigram_list;
 	vector<struct Bigram> bigram_list;
@@ -746,9 +795,18 @@ int LanguageModel::build(const char *model_file,const char *index_file)
 		unigram_list[unigram_list.size() - 1].end = bigram_list.size();
 	fclose(fp_model);
 
-	/* build term da */
-	DABuilder builder;
-	builder.build(&term_id_list[0],&term_id_list[0] + term_id_list.size());
+	/* place the unigrams by the new ids, and keep the grams under each of
+	 * them sorted by id for bisearch */
+	vector<struct Unigram> sorted_unigrams(unigram_list.size());
+	for (size_t i = 0;i < unigram_list.size();++i)
+		sorted_unigrams[sorted_ids[i] - _oov_id] = unigram_list[i];
+	unigram_list.swap(sorted_unigrams);
+	for (size_t i = 0;i < unigram_list.size();++i)
+		std::sort(bigram_list.begin() + unigram_list[i].begin,
+				bigram_list.begin() + unigram_list[i].end,lessById<struct Bigram>);
+	for (size_t i = 0;i < bigram_list.size();++i)
+		std::sort(trigram_list.begin() + bigram_list[i].begin,
+				trigram_list.begin() + bigram_list[i].end,lessById<struct Trigram>);
 
 	/* ģдļ */
 	FILE *fp_index = fopen(index_file,"wb");
@@ -838,8 +896,11 @@ int LanguageModel::build(const char *model_file,const char *index_file)
 	return 0;
 }
 
-int LanguageModel::load(const char *index_file)
+int LanguageModel::load(const char *index_file,bool use_mmap,int mmap_flags)
 {
+	/* drop a previous index, shared or not */
+	release();
+
 	uint64_t st_file_size = getFileSize(index_file);
 
 	FILE *fp_index = fopen(index_file,"rb");
@@ -875,12 +936,26 @@ int LanguageModel::load(const char *index_file)
 
 	/* load da */
 	fclose(fp_index);
-	fstream ifs(index_file,std::ios::in|std::ios::binary);
-	ifs.seekp(offset);
-
-	uint32_t read_size = _trie.read(ifs);
+	uint32_t read_size = 0u;
+	if (use_mmap) {
+#ifdef DASTRIE_HAS_MMAP
+		read_size = _trie.open(index_file,offset,mmap_flags);
+#else
+		ERR("mmap is not supported on this platform.\n");
+		return 3;
+#endif
+	} else {
+		fstream ifs(index_file,std::ios::in|std::ios::binary);
+		ifs.seekp(offset);
+		read_size = _trie.read(ifs);
+		ifs.close();
+	}
 	DLOG("read_size = %u,expected %u\n",read_size,da_size);
-	ifs.close();
+	if (read_size != da_size) {
+		ERR("failed to load the double array,loaded size = %u while %u"
+				" expected.\n",read_size,da_size);
+		return 3;
+	}
 	offset += da_size;
 
 	if (record_count != _trie.size()) {
@@ -951,38 +1026,147 @@ int LanguageModel::load(const char *index_file)
 	return 0;
 }
 
+
+#ifdef DASTRIE_HAS_MMAP
+/*
+ * Writes a language model index in the layout of a shared image: the
+ * record count and the sizes of the da and the ngram buffers (8 bytes
+ * each), the da padded to 8 bytes, and the ngram buffers, so that every
+ * buffer is aligned where it lies in the image.
+ */
+struct SharedIndexLoader {
+	const char *index_file;
+
+	bool operator()(std::ostream &os)
+	{
+		std::ifstream ifs(index_file,std::ios::in|std::ios::binary);
+		string data((std::istreambuf_iterator<char>(ifs)),
+				std::istreambuf_iterator<char>());
+		uint64_t file_size = 0ull;
+		uint32_t record_count = 0u, da_size = 0u;
+		if (data.size() < 16) {
+			return false;
+		}
+		memcpy(&file_size,data.data(),sizeof(file_size));
+		memcpy(&record_count,data.data() + 8,sizeof(record_count));
+		memcpy(&da_size,data.data() + 12,sizeof(da_size));
+		if (file_size != data.size() || data.size() < 16ull + da_size) {
+			return false;
+		}
+
+		/* the ngram buffers follow the da, each after its count */
+		uint64_t header[5] = {record_count,da_size,0,0,0};
+		const size_t record_size[3] = {sizeof(struct Unigram),
+			sizeof(struct Bigram),sizeof(struct Trigram)};
+		size_t buffer_offset[3];
+		size_t offset = 16 + da_size;
+		for (int i = 0; i < 3; i++) {
+			uint32_t count = 0u;
+			if (data.size() < offset + sizeof(count)) {
+				return false;
+			}
+			memcpy(&count,data.data() + offset,sizeof(count));
+			buffer_offset[i] = offset + sizeof(count);
+			offset = buffer_offset[i] + (size_t)count * record_size[i];
+			if (data.size() < offset) {
+				return false;
+			}
+			header[2 + i] = count;
+		}
+
+		static const char padding[8] = {0};
+		os.write((const char *)header,sizeof(header));
+		os.write(data.data() + 16,da_size);
+		os.write(padding,(8 - da_size % 8) % 8);
+		for (int i = 0; i < 3; i++) {
+			os.write(data.data() + buffer_offset[i],header[2 + i] * record_size[i]);
+		}
+		return !os.fail();
+	}
+};
+
+int LanguageModel::attach(const char *name,const char *index_file)
+{
+	release();
+
+	SharedIndexLoader loader = {index_file};
+	if (!_image.attach(name,loader,dastrie::shared_image::identify(index_file))) {
+		ERR("failed to attach the shared language model index %s.\n",name);
+		return 1;
+	}
+
+	/* the buffers are used in place */
+	const char *p = _image.data();
+	uint64_t header[5];
+	memcpy(header,p,sizeof(header));
+	uint64_t da_offset = sizeof(header);
+	uint64_t uni_offset = da_offset + (header[1] + 7) / 8 * 8;
+	uint64_t bi_offset = uni_offset + header[2] * sizeof(struct Unigram);
+	uint64_t tri_offset = bi_offset + header[3] * sizeof(struct Bigram);
+	if (_image.size() < tri_offset + header[4] * sizeof(struct Trigram)) {
+		ERR("the shared language model index %s is truncated.\n",name);
+		release();
+		return 2;
+	}
+	if (_trie.assign(p + da_offset,header[1]) != header[1] ||
+			header[0] != _trie.size()) {
+		ERR("failed to attach the double array of %s.\n",name);
+		release();
+		return 3;
+	}
+	_uni_size = header[2];
+	_uni_buf = (struct Unigram *)(p + uni_offset);
+	_bi_size = header[3];
+	_bi_buf = (struct Bigram *)(p + bi_offset);
+	_tri_size = header[4];
+	_tri_buf = (struct Trigram *)(p + tri_offset);
+
+	/* check oov id */
+	uint32_t term_id = 0u;
+	if (!_trie.find(OOV,term_id) || (term_id != _oov_id)) {
+		ERR("invalid oov id <%u> while <%u> expected.\n",term_id,_oov_id);
+		release();
+		return 8;
+	}
+
+	LOG("the language model has been attached %s!\n",
+			_image.created() ? "and loaded" : "without loading");
+	return 0;
+}
+#endif
+
 /* õһԪֵ */
-double LanguageModel::getUnigramProb(const string &uni)
+double LanguageModel::getUnigramProb(const string &uni) const
 {
 	uint32_t id = getTermID(uni);
 	return getUnigramProb(id);
 }
 
-double LanguageModel::getUnigramProb(uint32_t id)
+double LanguageModel::getUnigramProb(uint32_t id) const
 {
 	return _uni_buf[id - 1].prob;
 }
 
-double LanguageModel::getLnUnigramProb(const string &uni)
+double LanguageModel::getLnUnigramProb(const string &uni) const
 {
 	uint32_t id = getTermID(uni);
 	return getLnUnigramProb(id);
 }
 
-double LanguageModel::getLnUnigramProb(uint32_t id)
+double LanguageModel::getLnUnigramProb(uint32_t id) const
 {
 	return log(_uni_buf[id - 1].prob);
 }
 
 /* õԪֵ */
-double LanguageModel::getBigramProb(const string &uni,const string &big)
+double LanguageModel::getBigramProb(const string &uni,const string &big) const
 {
 	uint32_t uni_id = getTermID(uni);
 	uint32_t bi_id = getTermID(big);
 	return getBigramProb(uni_id,bi_id);
 }
 
-double LanguageModel::getBigramProb(uint32_t uni_id,uint32_t bi_id)
+double LanguageModel::getBigramProb(uint32_t uni_id,uint32_t bi_id) const
 {
 	const struct Unigram &st_uni = _uni_buf[uni_id - 1];
 	/* search bigram term */
@@ -1000,14 +1184,14 @@ double LanguageModel::getBigramProb(uint32_t uni_id,uint32_t bi_id)
 	return prob;
 }
 
-double LanguageModel::getLnBigramProb(const string &uni,const string &big)
+double LanguageModel::getLnBigramProb(const string &uni,const string &big) const
 {
 	uint32_t uni_id = getTermID(uni);
 	uint32_t bi_id = getTermID(big);
 	return getLnBigramProb(uni_id,bi_id);
 }
 
-double LanguageModel::getLnBigramProb(uint32_t uni_id,uint32_t bi_id)
+double LanguageModel::getLnBigramProb(uint32_t uni_id,uint32_t bi_id) const
 {
 	const struct Unigram &st_uni = _uni_buf[uni_id - 1];
 	/* search bigram term */
@@ -1027,7 +1211,7 @@ double LanguageModel::getLnBigramProb(uint32_t uni_id,uint32_t bi_id)
 
 /* õԪֵ */ 
 double LanguageModel::getTrigramProb(const string &uni,const string &big,
-		const string &tri)
+		const string &tri) const
 {
 	uint32_t uni_id = getTermID(uni);
 	uint32_t bi_id = getTermID(big);
@@ -1037,7 +1221,7 @@ double LanguageModel::getTrigramProb(const string &uni,const string &big,
 }
 
 double LanguageModel::getTrigramProb(uint32_t uni_id,uint32_t bi_id,
-		uint32_t tri_id)
+		uint32_t tri_id) const
 {
 	const struct Unigram &st_uni = _uni_buf[uni_id - 1];
 	const struct Bigram *ptr_st_bi = bisearch<struct Bigram,uint32_t>(
@@ -1060,7 +1244,7 @@ double LanguageModel::getTrigramProb(uint32_t uni_id,uint32_t bi_id,
 }
 
 double LanguageModel::getLnTrigramProb(const string &uni,const string &big,
-		const string &tri)
+		const string &tri) const
 {
 	uint32_t uni_id = getTermID(uni);
 	uint32_t bi_id = getTermID(big);
@@ -1070,7 +1254,7 @@ double LanguageModel::getLnTrigramProb(const string &uni,const string &big,
 }
 
 double LanguageModel::getLnTrigramProb(uint32_t uni_id,uint32_t bi_id,
-		uint32_t tri_id)
+		uint32_t tri_id) const
 {
 	const struct Unigram &st_uni = _uni_buf[uni_id - 1];
 	const struct Bigram *ptr_st_bi = bisearch<struct Bigram,uint32_t>(
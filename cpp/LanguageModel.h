@@ -36,6 +36,7 @@ class LanguageModel {
 	typedef dastrie::builder<string,uint32_t> DABuilder;
 	typedef dastrie::trie<uint32_t> DATrie;
 	typedef DABuilder::record_type DARecord;
+	typedef dastrie::record_sorter<uint32_t> DASorter;
 
 	public:
 		/* ѵƵ */
@@ -82,6 +83,10 @@ class LanguageModel {
 		static double _unigram_interpolation;
 
 	private:
+#ifdef DASTRIE_HAS_MMAP
+		/* the shared index in which the trie and the buffers lie */
+		dastrie::shared_image _image;
+#endif
 		/* ʱӳ */
 		DATrie _trie;
 
@@ -107,39 +112,62 @@ class LanguageModel {
 		/* LMļ */
 		static int build(const char *model_file,const char *index_file);
 		/*  */
-		int load(const char *index_file);
+		int load(const char *index_file,bool use_mmap = false,
+				int mmap_flags = dastrie::MMAP_DEFAULT);
+#ifdef DASTRIE_HAS_MMAP
+		/* attach the index shared by the processes of the host under a
+		 * name, loading it from index_file in the first process */
+		int attach(const char *name,const char *index_file);
+#endif
 		/* õterm id */
-		uint32_t getTermID(const string &term);
+		uint32_t getTermID(const string &term) const;
+		/* get the term of a term id, requires parent links in the index */
+		bool getTerm(uint32_t id,string &term) const;
+		/* number of terms in the vocabulary */
+		uint32_t getVocabSize() const;
 		/* õһԪֵ */
-		double getUnigramProb(const string &uni); 
-		double getUnigramProb(uint32_t id);
-		double getLnUnigramProb(const string &uni); 
-		double getLnUnigramProb(uint32_t id);
+		double getUnigramProb(const string &uni) const; 
+		double getUnigramProb(uint32_t id) const;
+		double getLnUnigramProb(const string &uni) const; 
+		double getLnUnigramProb(uint32_t id) const;
 		/* õԪֵ */
-		double getBigramProb(const string &uni,const string &big);
-		double getBigramProb(uint32_t uni_id,uint32_t bi_id);
-		double getLnBigramProb(const string &uni,const string &big);
-		double getLnBigramProb(uint32_t uni_id,uint32_t bi_id);
+		double getBigramProb(const string &uni,const string &big) const;
+		double getBigramProb(uint32_t uni_id,uint32_t bi_id) const;
+		double getLnBigramProb(const string &uni,const string &big) const;
+		double getLnBigramProb(uint32_t uni_id,uint32_t bi_id) const;
 		/* õԪֵ */ 
 		double getTrigramProb(const string &uni,const string &big,
-				const string &tri);
-		double getTrigramProb(uint32_t uni_id,uint32_t bi_id,uint32_t tri_id);
+				const string &tri) const;
+		double getTrigramProb(uint32_t uni_id,uint32_t bi_id,uint32_t tri_id) const;
 		double getLnTrigramProb(const string &uni,const string &big,
-				const string &tri);
-		double getLnTrigramProb(uint32_t uni_id,uint32_t bi_id,uint32_t tri_id);
+				const string &tri) const;
+		double getLnTrigramProb(uint32_t uni_id,uint32_t bi_id,uint32_t tri_id) const;
 	public:
 		LanguageModel();
 		~LanguageModel();
 };
 
-inline uint32_t LanguageModel::getTermID(const string &term)
+inline uint32_t LanguageModel::getTermID(const string &term) const
 {
 	uint32_t id = 0;
 	/* oov id by default */
-	if (!_trie.find(term.c_str(),id))
+	if (!_trie.find(term,id))
 		id = _oov_id;
 	return id;
 }
 
+inline bool LanguageModel::getTerm(uint32_t id,string &term) const
+{
+	/* term ids are assigned to the sorted unigrams from the oov id */
+	if (id < _oov_id)
+		return false;
+	return _trie.restore_key(id - _oov_id,term);
+}
+
+inline uint32_t LanguageModel::getVocabSize() const
+{
+	return _trie.size();
+}
+
 }
 #endif
@@ -12,29 +12,30 @@ using std::string;
 
 const int CHECKING_COUNT = 50;
 const int WORKER_COUNT = 23;
-const int BUFFER_SIZE = 4096;
+const int RELOAD_COUNT = 5;
 const char *log_file_prefix = "../data/worker.log.";
 const char *index_file = "../data/lm.index";
-const char *vocab_file = "../data/lm.vocab";
 
 void *term_id_checking (void *ptr);
 
-void trim(char *query)
-{
-    while ((*query != '\0') && (*query != '\r') && 
-            (*query != '\n')) query++;
-    *query = '\0';
-}
-
 struct st_para
 {
     int id;
-    LanguageModel *plm;
-    vector<string> *pword_list;
+    dastrie::versioned<LanguageModel> *handle;
 };
 
 LanguageModel *plm;
-vector<string> word_list;
+
+/* reload the lm index, returns NULL on failure */
+static LanguageModel *load_lm()
+{
+    LanguageModel *lm = new LanguageModel();
+    if (lm->load(index_file) != 0) {
+        delete lm;
+        return NULL;
+    }
+    return lm;
+}
 
 int main()
 {
@@ -51,25 +52,27 @@ int main()
         return 2;
     }
 
-    /* load vocabulary */
-    char buffer[BUFFER_SIZE];
-    FILE *fp_in = fopen(vocab_file,"r");
-    while (fgets(buffer,sizeof(buffer),fp_in) != NULL) {
-        trim(buffer);
-        word_list.push_back(buffer);
+    /* the terms are restored from the index, no vocabulary is loaded */
+    string term;
+    if (!plm->getTerm(1,term)) {
+        fprintf(stderr,"The lm index has no parent links, rebuild it!\n");
+        delete plm;
+        return 3;
     }
-    fclose(fp_in);
 
-    fprintf(stdout,"word list size = %d\n",word_list.size());
+    fprintf(stdout,"word list size = %u\n",plm->getVocabSize());
     fflush(stdout);
 
+    /* the workers read the lm through a handle, which owns it */
+    dastrie::versioned<LanguageModel> handle(plm);
+    plm = NULL;
+
     pthread_t workers[WORKER_COUNT];
     /* initialize the workers */
     struct st_para para_list[WORKER_COUNT];
     for (size_t id = 0; id < WORKER_COUNT; id++) {
         para_list[id].id = id;
-        para_list[id].plm = plm;
-        para_list[id].pword_list = &word_list;
+        para_list[id].handle = &handle;
     }
 
     fprintf(stdout,"start to create workers...\n");
@@ -78,33 +81,46 @@ int main()
                 (void *)&para_list[id]);
     }
 
+    /* reload the index while the workers are checking */
+    for (int i = 0; i < RELOAD_COUNT; i++) {
+        LanguageModel *lm = load_lm();
+        if (lm == NULL) {
+            fprintf(stderr,"Failed to reload lm index!\n");
+            break;
+        }
+        handle.publish(lm);
+        handle.synchronize();
+        fprintf(stdout,"reloaded lm index, version %u\n",
+                (unsigned)handle.version());
+        fflush(stdout);
+    }
+
     for (size_t id = 0; id < WORKER_COUNT; id++) {
         pthread_join(workers[id],NULL);
     }
     fprintf(stdout,"all worker have quited...\n");
 
-    /* delete memory */
-    if (plm != NULL)
-        delete plm;
+    /* the handle deletes the lm */
 }
 
 void *term_id_checking (void *ptr)
 {
     struct st_para *para = (struct st_para *)ptr;
     int id = para->id;
-    LanguageModel *plm = para->plm;
-    vector<string> *pword_list = para->pword_list;
+    dastrie::versioned<LanguageModel> *handle = para->handle;
 
     char strbuf[128];
     sprintf(strbuf,"%s%d",log_file_prefix,id);
     FILE *fp_log = fopen(strbuf,"w");
     for (size_t i = 0; i < CHECKING_COUNT; i++) {
         fprintf(fp_log,"the %dth checking...\n",i);
-        for (size_t j = 0; j < pword_list->size(); j++) {
-            const string &term = pword_list->at(j);
+        /* pin the current lm for this checking */
+        dastrie::versioned<LanguageModel>::guard plm(*handle);
+        string term;
+        for (uint32_t j = 1; plm->getTerm(j,term); j++) {
             uint32_t id = plm->getTermID(term);
-            if (id != j + 1) {
-                fprintf(fp_log,"%s\t%u\t%d\n",term.c_str(),id,j + 1);
+            if (id != j) {
+                fprintf(fp_log,"%s\t%u\t%u\n",term.c_str(),id,j);
             }
         }
     }
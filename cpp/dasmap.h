@@ -13,10 +13,14 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 
 #include <vector>
 #include <string>
 #include <fstream>
+#include <sstream>
+#include <iterator>
+#include <algorithm>
 #include <exception>
 
 #include <sys/stat.h>
@@ -66,7 +70,7 @@ class dasmap {
     public:
         typedef T value_type;
         typedef uint32_t scope_type; 
-        typedef dastrie::builder<string, scope_type> builder_type;
+        typedef dastrie::builder<dastrie::key_view, dastrie::empty_type> builder_type;
         typedef dastrie::trie<scope_type> trie_type;
         typedef builder_type::record_type record_type;
 
@@ -75,13 +79,71 @@ class dasmap {
         dasmap(const string & index_path);
         ~dasmap();
 
-        bool load(const string & index_path);
+        bool load(const string & index_path, bool use_mmap = false,
+                int mmap_flags = dastrie::MMAP_DEFAULT);
         static bool build(const vector<string> & key_list, 
                 const vector<value_type> & value_list,
                 const string & index_path);
+        /* builds from an unsorted file of key<TAB>value lines, sorting the
+         * records in runs of at most memory_budget bytes on disk */
+        static bool build(const string & input_path, const string & index_path,
+                size_t memory_budget = 64 << 20, const string & temp_dir = "");
+        /* builds the index in memory from keys sorted in dictionary order */
+        bool assign(const vector<string> & key_list,
+                const vector<value_type> & value_list);
         bool find(const string & key,value_type & value) const;
+#ifdef DASTRIE_HAS_MMAP
+        /* attaches the index shared by the processes of the host under a
+         * name, loading it from index_path in the first process or
+         * again when index_path has changed */
+        bool attach(const string & name, const string & index_path);
+#endif
 
     private:
+#ifdef DASTRIE_HAS_THREADS
+        friend struct overlay_traits<dasmap>;
+#endif
+
+        /* feeds the sorted keys to the builder and keeps their values in
+         * key order, i.e., in rank order */
+        class value_collector {
+            public:
+                value_collector(record_sorter<value_type> & sorter,
+                        vector<value_type> & value_list)
+                    : sorter_(sorter), value_list_(value_list) {}
+                bool next(string & key, dastrie::empty_type & value) {
+                    value_type v;
+                    if (!sorter_.next(key,v))
+                        return false;
+                    value_list_.push_back(v);
+                    return true;
+                }
+                size_t size() const { return sorter_.size(); }
+                const double *frequencies() const { return sorter_.frequencies(); }
+
+            private:
+                record_sorter<value_type> & sorter_;
+                vector<value_type> & value_list_;
+        };
+
+        static bool write(builder_type & builder,
+                const vector<value_type> & value_list,
+                const string & index_path);
+        /* drops the da and the values, shared or not */
+        void release();
+
+#ifdef DASTRIE_HAS_MMAP
+        /* writes an index in the layout of a shared image: the da size and
+         * the value count (8 bytes each), the da padded to 16 bytes and the
+         * values, so that the values are aligned in the image */
+        struct shared_loader {
+            const string & index_path;
+            bool operator()(std::ostream & os) const;
+        };
+
+        /* the shared index in which the da and the values lie */
+        shared_image image_;
+#endif
         trie_type da_;
         value_type *value_list_;
         scope_type size_; 
@@ -98,9 +160,9 @@ dasmap<T>::dasmap(const string & index_path) {
 }
 
 template <typename T>
-bool dasmap<T>::load(const string & index_path) {
-    size_ = 0;
-    value_list_ = NULL;
+bool dasmap<T>::load(const string & index_path, bool use_mmap,
+        int mmap_flags) {
+    release();
 
     struct stat st;
     if (stat(index_path.c_str(),&st) != 0) {
@@ -141,10 +203,20 @@ bool dasmap<T>::load(const string & index_path) {
     fclose(file);
 
     /* load da */
-    fstream ifs(index_path.c_str(),std::ios::in|std::ios::binary);
-    ifs.seekp(offset);
-    uint32_t read_size = da_.read(ifs);
-    ifs.close();
+    uint32_t read_size = 0u;
+    if (use_mmap) {
+#ifdef DASTRIE_HAS_MMAP
+        read_size = da_.open(index_path.c_str(),offset,mmap_flags);
+#else
+        DAMAP_ERROR("mmap is not supported on this platform!\n");
+        return false;
+#endif
+    } else {
+        fstream ifs(index_path.c_str(),std::ios::in|std::ios::binary);
+        ifs.seekp(offset);
+        read_size = da_.read(ifs);
+        ifs.close();
+    }
 
     if (read_size != da_size) {
         DAMAP_ERROR("Failed to load da,loaded size = %u while %u "
@@ -187,8 +259,21 @@ bool dasmap<T>::load(const string & index_path) {
 
 template <typename T>
 dasmap<T>::~dasmap() {
+    release();
+}
+
+template <typename T>
+void dasmap<T>::release() {
+#ifdef DASTRIE_HAS_MMAP
+    /* the values of a shared index belong to the image */
+    if (image_.attached()) {
+        da_.close();
+        image_.detach();
+        value_list_ = NULL;
+    }
+#endif
     if (value_list_ != NULL)
-        delete value_list_;
+        delete [] value_list_;
     value_list_ = NULL;
     size_ = 0;
 }
@@ -208,17 +293,54 @@ bool dasmap<T>::build(const vector<string> & key_list,
         return false;
     }
 
-    vector<record_type> record_list;
+    /* the records refer to the keys in key_list without copying them */
+    vector<record_type> record_list(key_list.size());
     for (size_t i = 0; i < key_list.size(); ++i) {
-        record_type record;
-        record.key = key_list[i];
-        record.value = i;
-        record_list.push_back(record);
+        record_list[i].key = key_list[i];
     } 
 
+    /* the rank of a key is the index of its value, no value in the trie */
     builder_type builder;
     builder.build(&record_list[0],&record_list[0] + record_list.size());
+    builder.annotate_ranks();
+
+    return write(builder,value_list,index_path);
+}
+
+template <typename T>
+bool dasmap<T>::build(const string & input_path, const string & index_path,
+        size_t memory_budget, const string & temp_dir) {
+
+    vector<value_type> value_list;
+    builder_type builder;
+    try {
+        std::ifstream ifs(input_path.c_str());
+        if (!ifs) {
+            DAMAP_ERROR("Failed to open input file");
+            return false;
+        }
+        record_sorter<value_type> sorter(memory_budget,temp_dir);
+        if (sorter.read(ifs) == 0) {
+            DAMAP_ERROR("Empty value set");
+            return false;
+        }
+        value_list.reserve(sorter.size());
+        value_collector collector(sorter,value_list);
+        builder.build_stream(collector);
+        builder.annotate_ranks();
+    } catch (const std::exception & e) {
+        DAMAP_ERROR("Failed to build: %s\n",e.what());
+        return false;
+    }
+
+    return write(builder,value_list,index_path);
+}
 
+template <typename T>
+bool dasmap<T>::write(builder_type & builder,
+        const vector<value_type> & value_list, const string & index_path) {
+
+    scope_type size = value_list.size();
     FILE *file = fopen(index_path.c_str(),"wb");
     if (file == NULL) {
         DAMAP_ERROR("Failed to open file");
@@ -236,7 +358,7 @@ bool dasmap<T>::build(const vector<string> & key_list,
     if (fwrite((char*)&da_size,1,sizeof(da_size),file) != sizeof(da_size)) {
         DAMAP_ERROR("Write the da size error");
         fclose(file);
-        return file;
+        return false;
     }
     fclose(file);
 
@@ -245,15 +367,23 @@ bool dasmap<T>::build(const vector<string> & key_list,
     builder.write(ofs);
     ofs.close();
 
-    da_size = getFileSize(index_path.c_str()) - sizeof(index_size)
-        - sizeof(da_size);
+    /* the index stores the da size in 32 bits, while the builder writes
+     * a 64-bit image ("SDAL") for a trie larger than 4 GB */
+    uint64_t written_size = getFileSize(index_path.c_str())
+        - sizeof(index_size) - sizeof(da_size);
+    if (written_size > 0xFFFFFFFFull) {
+        DAMAP_ERROR("The da size %llu does not fit in the index!\n",
+                (unsigned long long)written_size);
+        return false;
+    }
+    da_size = (uint32_t)written_size;
 
     file = fopen(index_path.c_str(),"r+b");
     fseek(file,sizeof(index_size),SEEK_SET);
     if (fwrite((char*)&da_size,1,sizeof(da_size),file) != sizeof(da_size)) {
         DAMAP_ERROR("Write the da size error");
         fclose(file);
-        return file;
+        return false;
     }
     fseek(file,0,SEEK_END);
  
@@ -284,18 +414,185 @@ bool dasmap<T>::build(const vector<string> & key_list,
     return true;
 }
 
+template <typename T>
+bool dasmap<T>::assign(const vector<string> & key_list,
+        const vector<value_type> & value_list) {
+
+    if (key_list.size() != value_list.size() || key_list.empty()) {
+        DAMAP_ERROR("Illegal value size");
+        return false;
+    }
+
+    std::stringstream ss;
+    try {
+        vector<record_type> record_list(key_list.size());
+        for (size_t i = 0; i < key_list.size(); ++i) {
+            record_list[i].key = key_list[i];
+        }
+        builder_type builder;
+        builder.build(&record_list[0],&record_list[0] + record_list.size());
+        builder.annotate_ranks();
+        builder.write(ss);
+    } catch (const std::exception & e) {
+        DAMAP_ERROR("Failed to build: %s\n",e.what());
+        return false;
+    }
+    release();
+    if (da_.read(ss) == 0) {
+        DAMAP_ERROR("Failed to load da\n");
+        return false;
+    }
+
+    size_ = value_list.size();
+    value_list_ = new value_type [size_];
+    std::copy(value_list.begin(),value_list.end(),value_list_);
+    return true;
+}
+
+#ifdef DASTRIE_HAS_MMAP
+template <typename T>
+bool dasmap<T>::shared_loader::operator()(std::ostream & os) const {
+    std::ifstream ifs(index_path.c_str(),std::ios::in|std::ios::binary);
+    string data((std::istreambuf_iterator<char>(ifs)),
+            std::istreambuf_iterator<char>());
+
+    uint64_t index_size = 0;
+    uint32_t da_size = 0u;
+    if (data.size() < sizeof(index_size) + sizeof(da_size)) {
+        DAMAP_ERROR("Load the index size error!");
+        return false;
+    }
+    memcpy(&index_size,data.data(),sizeof(index_size));
+    memcpy(&da_size,data.data() + sizeof(index_size),sizeof(da_size));
+
+    uint64_t offset = sizeof(index_size) + sizeof(da_size) + da_size;
+    scope_type size = 0;
+    if (index_size != data.size() || data.size() < offset + sizeof(size)) {
+        DAMAP_ERROR("Illegal index size!");
+        return false;
+    }
+    memcpy(&size,data.data() + offset,sizeof(size));
+    offset += sizeof(size);
+    if (data.size() < offset + (uint64_t)size * sizeof(value_type)) {
+        DAMAP_ERROR("Load value list error!\n");
+        return false;
+    }
+
+    static const char padding[16] = {0};
+    uint64_t header[2] = {da_size,size};
+    os.write((const char*)header,sizeof(header));
+    os.write(data.data() + sizeof(index_size) + sizeof(da_size),da_size);
+    os.write(padding,(16 - da_size % 16) % 16);
+    os.write(data.data() + offset,(size_t)size * sizeof(value_type));
+    return !os.fail();
+}
+
+template <typename T>
+bool dasmap<T>::attach(const string & name, const string & index_path) {
+    release();
+
+    shared_loader loader = {index_path};
+    if (!image_.attach(name.c_str(),loader,
+            shared_image::identify(index_path.c_str()))) {
+        DAMAP_ERROR("Attach the shared index %s error!\n",name.c_str());
+        return false;
+    }
+
+    /* the da and the values are used in place */
+    const char *p = image_.data();
+    uint64_t header[2];
+    memcpy(header,p,sizeof(header));
+    uint64_t value_offset = sizeof(header) + (header[0] + 15) / 16 * 16;
+    if (image_.size() < value_offset + header[1] * sizeof(value_type)
+            || da_.assign(p + sizeof(header),header[0]) != header[0]) {
+        DAMAP_ERROR("Illegal shared index %s!\n",name.c_str());
+        release();
+        return false;
+    }
+    size_ = header[1];
+    value_list_ = (value_type*)(p + value_offset);
+    return true;
+}
+#endif
+
 template <typename T>
 bool dasmap<T>::find(const string &key, value_type &value) const
 {
     scope_type offset;
-    if (!da_.find(key.c_str(),offset))
+    if (da_.has_ranks()) {
+        trie_type::size_type rank;
+        if (!da_.rank(key,rank))
+            return false;
+        offset = rank;
+    } else if (!da_.find(key,offset)) {
         return false;
-    if (offset > size_) {
+    }
+    if (offset >= size_) {
         return false;
     }
     value = value_list_[offset];  
     return true;
 }
 
+#ifdef DASTRIE_HAS_THREADS
+/* lets dastrie::overlay<dasmap<T> > merge updates into a new dasmap */
+template <typename T>
+struct overlay_traits<dasmap<T> > {
+    typedef dasmap<T> snapshot_type;
+    typedef T value_type;
+
+    /* enumerates the records in key order, i.e., in rank order */
+    class cursor {
+        public:
+            cursor(const snapshot_type & s)
+                : map_(s), cur_(s.da_.predict("")), rank_(0) {}
+            bool next() {
+                if (!cur_.next())
+                    return false;
+                typename snapshot_type::scope_type offset =
+                    map_.da_.has_ranks() ? rank_++ : cur_.value;
+                if (offset >= map_.size_)
+                    return false;
+                key = cur_.key;
+                value = map_.value_list_[offset];
+                return true;
+            }
+
+            string key;
+            value_type value;
+
+        private:
+            const snapshot_type & map_;
+            typename snapshot_type::trie_type::predictive_cursor cur_;
+            typename snapshot_type::scope_type rank_;
+    };
+
+    static bool find(const snapshot_type & s, const string & key,
+            value_type & value) {
+        return s.find(key,value);
+    }
+
+    template <typename source_type>
+    static snapshot_type *build(source_type & source) {
+        vector<string> key_list;
+        vector<value_type> value_list;
+        key_list.reserve(source.size());
+        value_list.reserve(source.size());
+        string key;
+        value_type value;
+        while (source.next(key,value)) {
+            key_list.push_back(key);
+            value_list.push_back(value);
+        }
+        snapshot_type *s = new snapshot_type;
+        if (!s->assign(key_list,value_list)) {
+            delete s;
+            DAMAP_THROW("Failed to build a merged dasmap");
+        }
+        return s;
+    }
+};
+#endif
+
 }
 #endif
@@ -0,0 +1,2452 @@
+/*
+ * Micro benchmarks for dastrie.
+ *
+ * Usage: dastrie_bench [lookup|batch|scan|predict|match|fuzzy|zipf|layout|tail|rank|build|parallel|stream|arena|insert|overlay|reload|filter|normalize|wide|shm|static] [num_keys]
+ *
+ * Keys are random short Chinese words (1-4 characters in UTF-8) drawn from
+ * the CJK Unified Ideographs block, which is the typical shape of the
+ * vocabularies used by LanguageModel and dasmap.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/time.h>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "dastrie.h"
+
+using std::string;
+using std::vector;
+
+typedef dastrie::builder<string, uint32_t> builder_type;
+typedef dastrie::trie<uint32_t> trie_type;
+typedef builder_type::record_type record_type;
+
+static double now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static uint32_t xorshift(uint32_t &s)
+{
+    s ^= s << 13;
+    s ^= s >> 17;
+    s ^= s << 5;
+    return s;
+}
+
+/* Appends a code point in the BMP as UTF-8. */
+static void append_utf8(string &str, uint32_t cp)
+{
+    if (cp < 0x80) {
+        str += (char)cp;
+    } else if (cp < 0x800) {
+        str += (char)(0xC0 | (cp >> 6));
+        str += (char)(0x80 | (cp & 0x3F));
+    } else {
+        str += (char)(0xE0 | (cp >> 12));
+        str += (char)(0x80 | ((cp >> 6) & 0x3F));
+        str += (char)(0x80 | (cp & 0x3F));
+    }
+}
+
+/* Generates n distinct random Chinese words sorted in dictionary order. */
+static void make_keys(size_t n, vector<string> &keys, uint32_t seed = 12345)
+{
+    /* A few thousand characters cover most of a real vocabulary. */
+    const uint32_t num_chars = 3500;
+    keys.clear();
+    while (keys.size() < n) {
+        size_t need = n - keys.size();
+        for (size_t i = 0; i < need; ++i) {
+            string key;
+            int len = 1 + xorshift(seed) % 4;
+            for (int j = 0; j < len; ++j) {
+                append_utf8(key, 0x4E00 + xorshift(seed) % num_chars);
+            }
+            keys.push_back(key);
+        }
+        std::sort(keys.begin(), keys.end());
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    }
+}
+
+static void build_trie(const vector<string> &keys, trie_type &trie,
+        builder_type &builder)
+{
+    vector<record_type> records(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        records[i].key = keys[i];
+        records[i].value = (uint32_t)i;
+    }
+    builder.build(&records[0], &records[0] + records.size());
+    trie.assign(builder.doublearray(), builder.tail(), builder.table());
+}
+
+/* Lays out queries as tokens of one line, as a tokenizer would see them. */
+static void make_queries(const vector<string> &keys, size_t n,
+        string &line, vector<size_t> &offsets, vector<size_t> &lengths)
+{
+    uint32_t seed = 54321;
+    line.clear();
+    offsets.clear();
+    lengths.clear();
+    for (size_t i = 0; i < n; ++i) {
+        const string &key = keys[xorshift(seed) % keys.size()];
+        offsets.push_back(line.size());
+        lengths.push_back(key.size());
+        line += key;
+        line += ' ';
+    }
+}
+
+static int bench_lookup(size_t num_keys)
+{
+    vector<string> keys;
+    make_keys(num_keys, keys);
+
+    trie_type trie;
+    builder_type builder;
+    build_trie(keys, trie, builder);
+
+    const size_t num_queries = 2000000;
+    string line;
+    vector<size_t> offsets, lengths;
+    make_queries(keys, num_queries, line, offsets, lengths);
+
+    /* Null-terminated copies for the const char* interface. */
+    vector<string> tokens(num_queries);
+    for (size_t i = 0; i < num_queries; ++i) {
+        tokens[i] = line.substr(offsets[i], lengths[i]);
+    }
+
+    printf("keys = %zu, queries = %zu\n", keys.size(), num_queries);
+
+    for (int round = 0; round < 3; ++round) {
+        uint64_t sum = 0;
+        uint32_t value = 0;
+
+        double t0 = now();
+        for (size_t i = 0; i < num_queries; ++i) {
+            if (trie.find(tokens[i].c_str(), value)) {
+                sum += value;
+            }
+        }
+        double t1 = now();
+        for (size_t i = 0; i < num_queries; ++i) {
+            if (trie.find(line.data() + offsets[i], lengths[i], value)) {
+                sum += value;
+            }
+        }
+        double t2 = now();
+        for (size_t i = 0; i < num_queries; ++i) {
+            if (trie.find(tokens[i], value)) {
+                sum += value;
+            }
+        }
+        double t3 = now();
+
+        printf("find(const char*)          %6.1f ns/lookup\n",
+                (t1 - t0) * 1e9 / num_queries);
+        printf("find(const char*, size_t)  %6.1f ns/lookup (slices of one line)\n",
+                (t2 - t1) * 1e9 / num_queries);
+        printf("find(const std::string&)   %6.1f ns/lookup (checksum %llu)\n",
+                (t3 - t2) * 1e9 / num_queries, (unsigned long long)sum);
+    }
+    return 0;
+}
+
+static int bench_batch(size_t num_keys)
+{
+    vector<string> keys;
+    make_keys(num_keys, keys);
+
+    trie_type trie;
+    builder_type builder;
+    double t0 = now();
+    build_trie(keys, trie, builder);
+    printf("keys = %zu, build = %.1f sec, double array = %zu bytes, tail = %zu bytes\n",
+            keys.size(), now() - t0, (size_t)builder.stat().da_size,
+            (size_t)builder.stat().tail_size);
+
+    const size_t num_queries = 2000000;
+    string line;
+    vector<size_t> offsets, lengths;
+    make_queries(keys, num_queries, line, offsets, lengths);
+    vector<const char*> ptrs(num_queries);
+    for (size_t i = 0; i < num_queries; ++i) {
+        ptrs[i] = line.data() + offsets[i];
+    }
+
+    vector<uint32_t> values(num_queries);
+    vector<uint64_t> mask(num_queries / 64 + 1);
+    const size_t batch_sizes[] = {1, 16, 32, 64};
+    for (int round = 0; round < 2; ++round) {
+        uint64_t sum = 0;
+        double t1 = now();
+        for (size_t i = 0; i < num_queries; ++i) {
+            uint32_t value;
+            if (trie.find(ptrs[i], lengths[i], value)) {
+                sum += value;
+            }
+        }
+        double t2 = now();
+        printf("find() loop           %6.1f ns/lookup\n",
+                (t2 - t1) * 1e9 / num_queries);
+
+        for (size_t b = 0; b < sizeof(batch_sizes) / sizeof(batch_sizes[0]); ++b) {
+            size_t batch = batch_sizes[b];
+            size_t found = 0;
+            double t3 = now();
+            for (size_t i = 0; i + batch <= num_queries; i += batch) {
+                found += trie.find_batch(&ptrs[i], &lengths[i], batch,
+                        &values[i], &mask[0]);
+            }
+            double t4 = now();
+            printf("find_batch(%2zu)        %6.1f ns/lookup (%.2fx, found %zu)\n",
+                    batch, (t4 - t3) * 1e9 / num_queries,
+                    (t2 - t1) / (t4 - t3), found);
+        }
+        if (sum == 0) {
+            printf("checksum %llu\n", (unsigned long long)sum);
+        }
+    }
+    return 0;
+}
+
+struct hit_counter
+{
+    size_t count;
+    uint64_t sum;
+
+    hit_counter() : count(0), sum(0) {}
+
+    void operator()(size_t begin, size_t length, const uint32_t &value)
+    {
+        ++count;
+        sum += begin + length + value;
+    }
+};
+
+static int bench_scan(size_t num_keys)
+{
+    vector<string> keys;
+    make_keys(num_keys, keys);
+
+    trie_type trie;
+    builder_type builder;
+    build_trie(keys, trie, builder);
+
+    /* Queries of 4-12 characters made of words and random characters. */
+    const size_t num_queries = 200000;
+    vector<string> queries(num_queries);
+    size_t total_bytes = 0;
+    uint32_t seed = 999;
+    for (size_t i = 0; i < num_queries; ++i) {
+        while (queries[i].size() < 12) {
+            if (xorshift(seed) % 2) {
+                queries[i] += keys[xorshift(seed) % keys.size()];
+            } else {
+                append_utf8(queries[i], 0x4E00 + xorshift(seed) % 3500);
+            }
+        }
+        total_bytes += queries[i].size();
+    }
+    printf("keys = %zu, queries = %zu, %zu bytes\n",
+            keys.size(), num_queries, total_bytes);
+
+    for (int round = 0; round < 2; ++round) {
+        /* A prefix cursor at every offset, as callers did before scan(). */
+        size_t hits = 0;
+        double t0 = now();
+        for (size_t i = 0; i < num_queries; ++i) {
+            const string &q = queries[i];
+            for (size_t j = 0; j < q.size(); ++j) {
+                trie_type::prefix_cursor pfx = trie.prefix(q.c_str() + j);
+                while (pfx.next()) {
+                    ++hits;
+                }
+            }
+        }
+        double t1 = now();
+
+        hit_counter hc;
+        for (size_t i = 0; i < num_queries; ++i) {
+            trie.scan(queries[i].data(), queries[i].size(), hc);
+        }
+        double t2 = now();
+
+        vector<trie_type::token_type> tokens;
+        size_t num_tokens = 0;
+        for (size_t i = 0; i < num_queries; ++i) {
+            tokens.clear();
+            num_tokens += trie.segment_forward(queries[i], tokens);
+        }
+        double t3 = now();
+        for (size_t i = 0; i < num_queries; ++i) {
+            tokens.clear();
+            num_tokens += trie.segment_backward(queries[i], tokens);
+        }
+        double t4 = now();
+
+        printf("prefix() at every offset  %7.1f ns/query (%zu hits)\n",
+                (t1 - t0) * 1e9 / num_queries, hits);
+        printf("scan()                    %7.1f ns/query (%zu hits)\n",
+                (t2 - t1) * 1e9 / num_queries, hc.count);
+        printf("segment_forward()         %7.1f ns/query\n",
+                (t3 - t2) * 1e9 / num_queries);
+        printf("segment_backward()        %7.1f ns/query (%zu tokens)\n",
+                (t4 - t3) * 1e9 / num_queries, num_tokens);
+    }
+    return 0;
+}
+
+static int bench_predict(size_t num_keys)
+{
+    vector<string> keys;
+    make_keys(num_keys, keys);
+
+    /* Zipf-like values so that the top records are well separated. */
+    vector<record_type> records(keys.size());
+    uint32_t seed = 4242;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        records[i].key = keys[i];
+        records[i].value = 1000000 / (1 + xorshift(seed) % 100000);
+    }
+    builder_type builder;
+    builder.build(&records[0], &records[0] + records.size());
+
+    trie_type plain;
+    plain.assign(builder.doublearray(), builder.tail(), builder.table());
+
+    builder.annotate_max();
+    std::stringstream ss;
+    builder.write(ss);
+    string image = ss.str();
+    trie_type annotated;
+    annotated.assign(image.data(), image.size());
+
+    /* One-character prefixes: the worst case for autocompletion. */
+    vector<string> prefixes;
+    for (size_t i = 0; i < 1000; ++i) {
+        prefixes.push_back(keys[xorshift(seed) % keys.size()].substr(0, 3));
+    }
+
+    const size_t k = 10;
+    vector<trie_type::completion_type> results;
+    size_t n1 = 0, n2 = 0, n3 = 0;
+    double t0 = now();
+    for (size_t i = 0; i < prefixes.size(); ++i) {
+        trie_type::predictive_cursor cur = plain.predict(prefixes[i]);
+        while (cur.next()) {
+            ++n1;
+        }
+    }
+    double t1 = now();
+    for (size_t i = 0; i < prefixes.size(); ++i) {
+        n2 += plain.predict_top(prefixes[i], k, results);
+    }
+    double t2 = now();
+    for (size_t i = 0; i < prefixes.size(); ++i) {
+        n3 += annotated.predict_top(prefixes[i], k, results);
+    }
+    double t3 = now();
+
+    printf("keys = %zu, one-character prefixes = %zu\n",
+            keys.size(), prefixes.size());
+    printf("predict() all records      %8.1f us/prefix (%zu records)\n",
+            (t1 - t0) * 1e6 / prefixes.size(), n1);
+    printf("predict_top(10) w/o MAXV   %8.1f us/prefix\n",
+            (t2 - t1) * 1e6 / prefixes.size());
+    printf("predict_top(10) with MAXV  %8.1f us/prefix (%zu/%zu records)\n",
+            (t3 - t2) * 1e6 / prefixes.size(), n3, n2);
+    return 0;
+}
+
+/* Compares match() with scan() on a text; the keys are sorted and unique. */
+static void match_text(const vector<string> &keys, const string &text)
+{
+    builder_type builder;
+    trie_type plain;
+    build_trie(keys, plain, builder);
+
+    double t0 = now();
+    builder.annotate_automaton();
+    double t1 = now();
+    std::stringstream ss;
+    builder.write(ss);
+    string image = ss.str();
+    trie_type trie;
+    trie.assign(image.data(), image.size());
+
+    printf("keys = %zu, text = %zu bytes, automaton = %.2f sec, image = %zu bytes\n",
+            keys.size(), text.size(), t1 - t0, image.size());
+
+    for (int round = 0; round < 2; ++round) {
+        hit_counter h1, h2, h3;
+        double t2 = now();
+        plain.scan(text.data(), text.size(), h1);
+        double t3 = now();
+        trie.match(text.data(), text.size(), h2);
+        double t4 = now();
+
+        /* Stream the text in 4 KB chunks. */
+        trie_type::match_state ms;
+        for (size_t i = 0; i < text.size(); i += 4096) {
+            size_t n = std::min((size_t)4096, text.size() - i);
+            trie.match(ms, text.data() + i, n, h3);
+        }
+        double t5 = now();
+
+        printf("scan()             %7.1f MB/s (%zu hits)\n",
+                text.size() / (t3 - t2) / 1e6, h1.count);
+        printf("match()            %7.1f MB/s (%zu hits)\n",
+                text.size() / (t4 - t3) / 1e6, h2.count);
+        printf("match() streaming  %7.1f MB/s (%zu hits, checksum %s)\n",
+                text.size() / (t5 - t4) / 1e6, h3.count,
+                (h1.sum == h2.sum && h2.sum == h3.sum) ? "ok" : "MISMATCH");
+    }
+}
+
+static int bench_match(size_t num_keys)
+{
+    const size_t text_size = 64 << 20;
+
+    /* A long text of words and random characters, like tagged addresses. */
+    vector<string> keys;
+    make_keys(num_keys, keys);
+    string text;
+    uint32_t seed = 777;
+    while (text.size() < text_size) {
+        if (xorshift(seed) % 2) {
+            text += keys[xorshift(seed) % keys.size()];
+        } else {
+            append_utf8(text, 0x4E00 + xorshift(seed) % 3500);
+        }
+    }
+    printf("short words:\n");
+    match_text(keys, text);
+
+    /*
+     * Long keys over a small alphabet, like DNA probes: scan() walks deep
+     * into the trie from every offset, while match() reads a byte once.
+     */
+    static const char acgt[] = "acgt";
+    keys.clear();
+    for (size_t i = 0; i < num_keys; ++i) {
+        string key;
+        for (size_t j = 0; j < 64; ++j) {
+            key += acgt[xorshift(seed) % 4];
+        }
+        keys.push_back(key);
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    text.clear();
+    while (text.size() < text_size) {
+        if (xorshift(seed) % 8 == 0) {
+            text += keys[xorshift(seed) % keys.size()];
+        }
+        text += acgt[xorshift(seed) % 4];
+    }
+    printf("long keys:\n");
+    match_text(keys, text);
+    return 0;
+}
+
+/* Splits a UTF-8 string into characters packed in integers. */
+static void utf8_units(const string &str, vector<uint32_t> &units)
+{
+    units.clear();
+    for (size_t i = 0; i < str.size();) {
+        uint8_t c = (uint8_t)str[i];
+        size_t n = (c >= 0xF0) ? 4 : (c >= 0xE0) ? 3 : (c >= 0xC0) ? 2 : 1;
+        uint32_t unit = 0;
+        for (size_t j = 0; j < n && i < str.size(); ++j) {
+            unit = (unit << 8) | (uint8_t)str[i++];
+        }
+        units.push_back(unit);
+    }
+}
+
+/* The edit distance by the full table, as python/strutils.py computes it. */
+static size_t edit_distance(const vector<uint32_t> &a, const vector<uint32_t> &b)
+{
+    vector<size_t> prev(b.size() + 1), row(b.size() + 1);
+    for (size_t j = 0; j <= b.size(); ++j) {
+        prev[j] = j;
+    }
+    for (size_t i = 1; i <= a.size(); ++i) {
+        row[0] = i;
+        for (size_t j = 1; j <= b.size(); ++j) {
+            size_t d = prev[j - 1] + (a[i - 1] == b[j - 1] ? 0 : 1);
+            d = std::min(d, prev[j] + 1);
+            row[j] = std::min(d, row[j - 1] + 1);
+        }
+        prev.swap(row);
+    }
+    return prev[b.size()];
+}
+
+static int bench_fuzzy(size_t num_keys)
+{
+    vector<string> keys;
+    make_keys(num_keys, keys);
+
+    trie_type trie;
+    builder_type builder;
+    build_trie(keys, trie, builder);
+
+    /* Queries are keys with one character replaced. */
+    const size_t num_queries = 100;
+    vector<string> queries;
+    uint32_t seed = 31337;
+    for (size_t i = 0; i < num_queries; ++i) {
+        string q = keys[xorshift(seed) % keys.size()];
+        size_t pos = (xorshift(seed) % (q.size() / 3)) * 3;
+        string c;
+        append_utf8(c, 0x4E00 + xorshift(seed) % 3500);
+        q.replace(pos, 3, c);
+        queries.push_back(q);
+    }
+
+    vector<vector<uint32_t> > units(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        utf8_units(keys[i], units[i]);
+    }
+
+    printf("keys = %zu, queries = %zu\n", keys.size(), num_queries);
+    for (size_t k = 1; k <= 2; ++k) {
+        size_t n1 = 0, n2 = 0;
+        vector<uint32_t> q;
+        double t0 = now();
+        for (size_t i = 0; i < num_queries; ++i) {
+            utf8_units(queries[i], q);
+            for (size_t j = 0; j < keys.size(); ++j) {
+                if (edit_distance(units[j], q) <= k) {
+                    ++n1;
+                }
+            }
+        }
+        double t1 = now();
+        vector<trie_type::fuzzy_type> results;
+        for (size_t i = 0; i < num_queries; ++i) {
+            results.clear();
+            n2 += trie.fuzzy_find(queries[i], k, results, dastrie::FUZZY_UTF8);
+        }
+        double t2 = now();
+
+        printf("k = %zu: brute force %9.3f ms/query, fuzzy_find() %7.3f ms/query (%zu/%zu records)\n",
+                k, (t1 - t0) * 1e3 / num_queries, (t2 - t1) * 1e3 / num_queries,
+                n2, n1);
+    }
+    return 0;
+}
+
+/* Counts hardware cache misses of this thread; -1 if unavailable. */
+class miss_counter
+{
+    int fd;
+
+public:
+    int error;
+
+    miss_counter() : fd(-1), error(ENOSYS)
+    {
+#if defined(__linux__)
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        error = (fd < 0) ? errno : 0;
+#endif
+    }
+
+    ~miss_counter()
+    {
+#if defined(__linux__)
+        if (fd >= 0) {
+            close(fd);
+        }
+#endif
+    }
+
+    void start()
+    {
+#if defined(__linux__)
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    long long stop()
+    {
+        long long count = -1;
+#if defined(__linux__)
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(fd, &count, sizeof(count)) != sizeof(count)) {
+                count = -1;
+            }
+        }
+#endif
+        return count;
+    }
+};
+
+/* Simulates a set-associative cache with LRU replacement. */
+class cache_model
+{
+    size_t ways;
+    vector<uintptr_t> tags;
+    vector<uint64_t> stamps;
+    uint64_t clock;
+
+public:
+    size_t misses;
+
+    cache_model(size_t size, size_t assoc)
+        : ways(assoc), tags(size / 64, (uintptr_t)-1), stamps(size / 64, 0),
+          clock(0), misses(0)
+    {
+    }
+
+    void access(uintptr_t line)
+    {
+        size_t set = (size_t)(line % (tags.size() / ways)) * ways;
+        size_t victim = set;
+        for (size_t i = set; i < set + ways; ++i) {
+            if (tags[i] == line) {
+                stamps[i] = ++clock;
+                return;
+            }
+            if (stamps[i] < stamps[victim]) {
+                victim = i;
+            }
+        }
+        tags[victim] = line;
+        stamps[victim] = ++clock;
+        ++misses;
+    }
+};
+
+/* Records the cache lines that look-ups read, by retracing trie::find(). */
+class traced_trie : public trie_type
+{
+public:
+    void trace(const string &key, vector<uintptr_t> &lines) const
+    {
+        const char *p = key.c_str();
+        size_type cur = dastrie::INITIAL_INDEX;
+        for (;;) {
+            lines.push_back((uintptr_t)m_da.address(cur) >> 6);
+            base_type base = get_base(cur);
+            if (base < 0) {
+                const char *tail = m_tail.str((size_type)-base);
+                const char *end = tail + strlen(tail) + 1 + sizeof(uint32_t);
+                for (uintptr_t l = (uintptr_t)tail >> 6; l <= ((uintptr_t)end - 1) >> 6; ++l) {
+                    lines.push_back(l);
+                }
+                return;
+            }
+            cur = descend(cur, (uint8_t)*p);
+            if (cur == dastrie::INVALID_INDEX || *p++ == 0) {
+                return;
+            }
+        }
+    }
+};
+
+/*
+ * Compares look-ups on the depth-first and weighted placements for Zipfian
+ * queries. The latency differs only when the trie outgrows the L2 cache,
+ * e.g., with 1000000 keys; the simulated misses show the effect anyway.
+ */
+static int bench_zipf(size_t num_keys)
+{
+    vector<string> keys;
+    make_keys(num_keys, keys);
+
+    /* Popularity ranks are independent of the dictionary order. */
+    vector<size_t> rank(keys.size());
+    for (size_t i = 0; i < rank.size(); ++i) {
+        rank[i] = i;
+    }
+    uint32_t seed = 2024;
+    for (size_t i = rank.size(); 1 < i; --i) {
+        std::swap(rank[i - 1], rank[xorshift(seed) % i]);
+    }
+    vector<double> weights(keys.size()), cdf(keys.size());
+    double total = 0.;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        weights[i] = 1.0 / (1 + rank[i]);
+    }
+    vector<size_t> by_rank(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        by_rank[rank[i]] = i;
+    }
+    for (size_t r = 0; r < keys.size(); ++r) {
+        total += weights[by_rank[r]];
+        cdf[r] = total;
+    }
+
+    vector<record_type> records(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        records[i].key = keys[i];
+        records[i].value = (uint32_t)i;
+    }
+    builder_type builder;
+    traced_trie plain, hot;
+    double t0 = now();
+    builder.build(&records[0], &records[0] + records.size());
+    plain.assign(builder.doublearray(), builder.tail(), builder.table());
+    double t1 = now();
+    builder.build(&records[0], &records[0] + records.size(), &weights[0]);
+    hot.assign(builder.doublearray(), builder.tail(), builder.table());
+    double t2 = now();
+
+    /* Queries drawn from Zipf(1) over the ranks. */
+    const size_t num_queries = 2000000;
+    vector<string> queries(num_queries);
+    for (size_t i = 0; i < num_queries; ++i) {
+        double u = (xorshift(seed) / 4294967296.0) * total;
+        size_t r = std::lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin();
+        queries[i] = keys[by_rank[std::min(r, keys.size() - 1)]];
+    }
+    const traced_trie *tries[] = {&plain, &hot};
+    const char *names[] = {"dfs", "weighted"};
+
+    /* The cache lines read by the hottest keys that serve 50%/90% of queries. */
+    printf("keys = %zu, queries = %zu, build = %.2f / %.2f sec (dfs / weighted)\n",
+            keys.size(), num_queries, t1 - t0, t2 - t1);
+    const double shares[] = {0.5, 0.9};
+    for (size_t s = 0; s < 2; ++s) {
+        vector<uintptr_t> l1, l2;
+        for (size_t r = 0; r < keys.size() && cdf[r] < shares[s] * total; ++r) {
+            plain.trace(keys[by_rank[r]], l1);
+            hot.trace(keys[by_rank[r]], l2);
+        }
+        size_t n1 = std::set<uintptr_t>(l1.begin(), l1.end()).size();
+        size_t n2 = std::set<uintptr_t>(l2.begin(), l2.end()).size();
+        printf("working set for %2.0f%% of queries: %8zu KB (dfs), %8zu KB (weighted)\n",
+                shares[s] * 100, n1 * 64 / 1024, n2 * 64 / 1024);
+    }
+
+    /*
+     * Replay the cache lines of the queries through a model of the L2
+     * cache, which counts misses where hardware counters are unavailable
+     * (e.g., in containers) and without the noise of other processes.
+     */
+    long cache_size = 0, cache_assoc = 0;
+#if defined(_SC_LEVEL2_CACHE_SIZE) && defined(_SC_LEVEL2_CACHE_ASSOC)
+    cache_size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    cache_assoc = sysconf(_SC_LEVEL2_CACHE_ASSOC);
+#endif
+    if (cache_size <= 0 || cache_assoc <= 0) {
+        cache_size = 1 << 20;
+        cache_assoc = 16;
+    }
+    for (int k = 0; k < 2; ++k) {
+        cache_model cache((size_t)cache_size, (size_t)cache_assoc);
+        vector<uintptr_t> lines;
+        for (size_t i = 0; i < num_queries; ++i) {
+            lines.clear();
+            tries[k]->trace(queries[i], lines);
+            for (size_t j = 0; j < lines.size(); ++j) {
+                cache.access(lines[j]);
+            }
+        }
+        printf("%-9s %.3f misses/lookup in a %ld KB %ld-way LRU cache (simulated)\n",
+                names[k], (double)cache.misses / num_queries,
+                cache_size / 1024, cache_assoc);
+    }
+
+    miss_counter mc;
+    if (mc.error != 0) {
+        printf("hardware cache misses unavailable (perf_event_open: %s)\n",
+                strerror(mc.error));
+    }
+    for (int round = 0; round < 3; ++round) {
+        uint64_t sum = 0;
+        uint32_t value;
+        for (int k = 0; k < 2; ++k) {
+            mc.start();
+            double t3 = now();
+            for (size_t i = 0; i < num_queries; ++i) {
+                if (tries[k]->find(queries[i], value)) {
+                    sum += value;
+                }
+            }
+            double t4 = now();
+            long long misses = mc.stop();
+            if (misses < 0) {
+                printf("%-9s %6.1f ns/lookup\n",
+                        names[k], (t4 - t3) * 1e9 / num_queries);
+            } else {
+                printf("%-9s %6.1f ns/lookup, %.2f cache misses/lookup\n",
+                        names[k], (t4 - t3) * 1e9 / num_queries,
+                        (double)misses / num_queries);
+            }
+        }
+        if (sum == 0) {
+            printf("checksum %llu\n", (unsigned long long)sum);
+        }
+    }
+    return 0;
+}
+
+/* Writes the trie in the layout of the traits and times look-ups on it. */
+template <class traits>
+static void bench_layout_one(const char *name, builder_type &builder,
+        const vector<string> &tokens)
+{
+    typedef dastrie::trie<uint32_t, traits> layout_trie_type;
+    size_t n = builder.doublearray().size();
+
+    if (!builder.template fits<traits>()) {
+        printf("%-6s  does not fit (max BASE %d)\n", name, (int)traits::max_base());
+        return;
+    }
+
+    std::stringstream ss;
+    builder.template write_as<traits>(ss);
+    string image = ss.str();
+    layout_trie_type trie;
+    if (trie.assign(image.data(), image.size()) == 0) {
+        printf("%-6s  failed to read the image\n", name);
+        return;
+    }
+
+    double best = 0.;
+    uint64_t sum = 0;
+    for (int round = 0; round < 3; ++round) {
+        uint32_t value = 0;
+        double t0 = now();
+        for (size_t i = 0; i < tokens.size(); ++i) {
+            if (trie.find(tokens[i].c_str(), value)) {
+                sum += value;
+            }
+        }
+        double t = (now() - t0) * 1e9 / tokens.size();
+        if (round == 0 || t < best) {
+            best = t;
+        }
+    }
+
+    printf("%-6s  %8.1f KB double array  %8.1f KB image  %6.1f ns/lookup (checksum %llu)\n",
+            name, dastrie::doublearray_storage<traits>::bytes(n) / 1024.,
+            image.size() / 1024., best, (unsigned long long)sum);
+}
+
+static int bench_layout(size_t num_keys)
+{
+    vector<string> keys;
+    make_keys(num_keys, keys);
+
+    trie_type trie;
+    builder_type builder;
+    build_trie(keys, trie, builder);
+
+    const size_t num_queries = 2000000;
+    string line;
+    vector<size_t> offsets, lengths;
+    make_queries(keys, num_queries, line, offsets, lengths);
+    vector<string> tokens(num_queries);
+    for (size_t i = 0; i < num_queries; ++i) {
+        tokens[i] = line.substr(offsets[i], lengths[i]);
+    }
+
+    printf("keys = %zu, queries = %zu, elements = %zu\n",
+            keys.size(), num_queries, builder.doublearray().size());
+    bench_layout_one<dastrie::doublearray4_traits>("SDA4", builder, tokens);
+    bench_layout_one<dastrie::doublearray5_traits>("SDA5", builder, tokens);
+    bench_layout_one<dastrie::doublearray8_traits>("SDA8", builder, tokens);
+    bench_layout_one<dastrie::doublearray9_traits>("SDA9", builder, tokens);
+    bench_layout_one<dastrie::doublearray_split_traits>("split", builder, tokens);
+    return 0;
+}
+
+/* Generates n distinct address-like keys; street names and numbers recur
+ * in many districts, so the keys share long suffixes. */
+static void make_addresses(size_t n, vector<string> &keys, uint32_t seed = 777)
+{
+    static const char *suffixes[] = {
+        "\xe8\xb7\xaf", "\xe8\xa1\x97", "\xe5\xb7\xb7", "\xe5\xa4\xa7\xe9\x81\x93",
+    };  /* road, street, lane, avenue */
+    keys.clear();
+    while (keys.size() < n) {
+        size_t need = n - keys.size();
+        for (size_t i = 0; i < need; ++i) {
+            string key;
+            /* district + street name + suffix + number + "hao" */
+            for (int j = 0; j < 2; ++j) {
+                append_utf8(key, 0x4E00 + xorshift(seed) % 300);
+            }
+            key += "\xe5\x8c\xba";
+            /* Street names recur across districts. */
+            uint32_t street = xorshift(seed) % 2000;
+            append_utf8(key, 0x4E00 + street % 50);
+            append_utf8(key, 0x4E00 + street / 50);
+            key += suffixes[xorshift(seed) % 4];
+            char num[16];
+            snprintf(num, sizeof(num), "%u", 1 + xorshift(seed) % 300);
+            key += num;
+            key += "\xe5\x8f\xb7";
+            keys.push_back(key);
+        }
+        std::sort(keys.begin(), keys.end());
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    }
+}
+
+/* Times look-ups of every key on a trie. */
+static double time_lookups(const trie_type &trie, const vector<string> &keys,
+        const vector<size_t> &order, uint64_t &sum)
+{
+    double best = 0.;
+    for (int round = 0; round < 3; ++round) {
+        uint32_t value = 0;
+        double t0 = now();
+        for (size_t i = 0; i < order.size(); ++i) {
+            if (trie.find(keys[order[i]], value)) {
+                sum += value;
+            }
+        }
+        double t = (now() - t0) * 1e9 / order.size();
+        if (round == 0 || t < best) {
+            best = t;
+        }
+    }
+    return best;
+}
+
+static void bench_tail_keys(const char *name, const vector<string> &keys)
+{
+    vector<record_type> records(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        records[i].key = keys[i];
+        records[i].value = (uint32_t)i;
+    }
+    vector<size_t> order(keys.size());
+    uint32_t seed = 4242;
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = xorshift(seed) % keys.size();
+    }
+
+    builder_type builder;
+    trie_type plain, shared;
+    builder.build(&records[0], &records[0] + records.size());
+    size_t plain_size = builder.tail().bytes();
+    plain.assign(builder.doublearray(), builder.tail(), builder.table());
+
+    double t0 = now();
+    builder.share_tail();
+    double t1 = now();
+    size_t shared_size = builder.tail().bytes();
+    shared.assign(builder.doublearray(), builder.tail(), builder.table());
+
+    uint64_t sum = 0;
+    double plain_ns = time_lookups(plain, keys, order, sum);
+    double shared_ns = time_lookups(shared, keys, order, sum);
+    printf("%-9s keys = %zu, TAIL = %zu -> %zu bytes (%.1f%%), share_tail() %.2f sec\n",
+            name, keys.size(), plain_size, shared_size,
+            100. * ((double)shared_size - plain_size) / plain_size, t1 - t0);
+    printf("%-9s lookup %.1f -> %.1f ns (checksum %llu)\n",
+            name, plain_ns, shared_ns, (unsigned long long)sum);
+}
+
+static int bench_tail(size_t num_keys)
+{
+    vector<string> keys;
+    make_keys(num_keys, keys);
+    bench_tail_keys("words", keys);
+    make_addresses(num_keys, keys);
+    bench_tail_keys("addresses", keys);
+    return 0;
+}
+
+/*
+ * Compares a trie storing a 4-byte value per key with a value-less trie
+ * mapping keys to ranks, which index a parallel array of the values.
+ */
+static int bench_rank(size_t num_keys)
+{
+    typedef dastrie::builder<string, dastrie::empty_type> rank_builder_type;
+    typedef dastrie::trie<dastrie::empty_type> rank_trie_type;
+
+    vector<string> keys;
+    make_keys(num_keys, keys);
+    vector<size_t> order(keys.size());
+    uint32_t seed = 4242;
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = xorshift(seed) % keys.size();
+    }
+
+    builder_type builder;
+    trie_type valued;
+    build_trie(keys, valued, builder);
+    size_t valued_size = builder.tail().bytes();
+
+    vector<rank_builder_type::record_type> records(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        records[i].key = keys[i];
+    }
+    rank_builder_type rank_builder;
+    rank_builder.build(&records[0], &records[0] + records.size());
+    rank_builder.annotate_ranks();
+    std::stringstream ss;
+    rank_builder.write(ss);
+    rank_trie_type ranked;
+    ranked.read(ss);
+    size_t ranked_size = rank_builder.tail().bytes();
+
+    vector<uint32_t> values(keys.size());
+    for (size_t i = 0; i < values.size(); ++i) {
+        values[i] = (uint32_t)i;
+    }
+
+    uint64_t sum = 0;
+    double valued_ns = time_lookups(valued, keys, order, sum);
+    double ranked_ns = 0.;
+    for (int round = 0; round < 3; ++round) {
+        double t0 = now();
+        for (size_t i = 0; i < order.size(); ++i) {
+            rank_trie_type::size_type r;
+            if (ranked.rank(keys[order[i]], r)) {
+                sum += values[r];
+            }
+        }
+        double t = (now() - t0) * 1e9 / order.size();
+        if (round == 0 || t < ranked_ns) {
+            ranked_ns = t;
+        }
+    }
+
+    printf("keys = %zu, TAIL = %zu -> %zu bytes (%.1f%%), RANK = %zu bytes\n",
+            keys.size(), valued_size, ranked_size,
+            100. * ((double)ranked_size - valued_size) / valued_size,
+            (ranked_size / 64 + 1) * sizeof(uint32_t));
+    printf("lookup %.1f ns (find) -> %.1f ns (rank + array) (checksum %llu)\n",
+            valued_ns, ranked_ns, (unsigned long long)sum);
+    return 0;
+}
+
+static void bench_build_keys(const char *name, const vector<string> &keys)
+{
+    vector<record_type> records(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        records[i].key = keys[i];
+        records[i].value = (uint32_t)i;
+    }
+
+    builder_type builder;
+    double t0 = now();
+    builder.build(&records[0], &records[0] + records.size());
+    double t1 = now();
+    const builder_type::stat_type &stat = builder.stat();
+    printf("%-9s keys = %zu, build = %.2f sec, elements = %zu, usage = %.4f, "
+            "trials = %.2f per element\n",
+            name, keys.size(), t1 - t0, (size_t)stat.da_num_total,
+            stat.da_usage, stat.bt_avg_base_trials);
+}
+
+static int bench_build(size_t num_keys)
+{
+    vector<string> keys;
+    make_keys(num_keys, keys);
+    bench_build_keys("words", keys);
+    make_addresses(num_keys, keys);
+    bench_build_keys("addresses", keys);
+    return 0;
+}
+
+/* Writes the image of a trie with parent links, for restore_key(). */
+static string parallel_image(builder_type &builder)
+{
+    builder.annotate_keys();
+    std::stringstream ss;
+    builder.write(ss);
+    return ss.str();
+}
+
+/*
+ * Counts the keys on which two tries disagree: the value of the key, the
+ * key restored from its record, and the lookups of the key followed by a
+ * byte and of the key without its last byte, which are mostly misses.
+ */
+static size_t count_mismatches(const trie_type &expected, const trie_type &actual,
+        const vector<string> &keys)
+{
+    size_t mismatches = 0;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        uint32_t a = 0, b = 0;
+        if (!actual.find(keys[i], b) || b != (uint32_t)i) {
+            ++mismatches;
+        }
+        if (actual.restore_key(i) != keys[i]) {
+            ++mismatches;
+        }
+        string miss = keys[i] + 'x';
+        a = b = 0;
+        if (expected.find(miss, a) != actual.find(miss, b) || a != b) {
+            ++mismatches;
+        }
+        miss = keys[i].substr(0, keys[i].size() - 1);
+        a = b = 0;
+        if (expected.find(miss, a) != actual.find(miss, b) || a != b) {
+            ++mismatches;
+        }
+    }
+    return mismatches;
+}
+
+static void bench_parallel_keys(const char *name, const vector<string> &keys)
+{
+    vector<record_type> records(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        records[i].key = keys[i];
+        records[i].value = (uint32_t)i;
+    }
+
+    /* The serial build is the reference for the results. */
+    builder_type serial;
+    serial.build(&records[0], &records[0] + records.size());
+    string serial_image = parallel_image(serial);
+    trie_type expected;
+    expected.assign(serial_image.data(), serial_image.size());
+
+    for (size_t threads = 1; threads <= 16; threads *= 2) {
+        builder_type builder;
+        double t0 = now();
+        builder.build_parallel(&records[0], &records[0] + records.size(), threads);
+        double t1 = now();
+        const builder_type::stat_type &stat = builder.stat();
+        string image = parallel_image(builder);
+        trie_type actual;
+        actual.assign(image.data(), image.size());
+        printf("%-9s keys = %zu, threads = %2zu, build = %.2f sec, "
+                "elements = %zu, usage = %.4f, mismatches = %zu\n",
+                name, keys.size(), threads, t1 - t0,
+                (size_t)stat.da_num_total, stat.da_usage,
+                count_mismatches(expected, actual, keys));
+    }
+}
+
+/* Makes a few sparse keys over a small alphabet, like tags of a DNA probe. */
+static void make_probes(size_t n, vector<string> &keys, uint32_t seed = 2024)
+{
+    keys.clear();
+    while (keys.size() < n) {
+        size_t need = n - keys.size();
+        for (size_t i = 0; i < need; ++i) {
+            string key;
+            int len = 1 + xorshift(seed) % 12;
+            for (int j = 0; j < len; ++j) {
+                key += (char)('a' + xorshift(seed) % 8);
+            }
+            keys.push_back(key);
+        }
+        std::sort(keys.begin(), keys.end());
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    }
+}
+
+static int bench_parallel(size_t num_keys)
+{
+#if DASTRIE_HAS_THREADS
+    vector<string> keys;
+    make_keys(num_keys, keys);
+    bench_parallel_keys("words", keys);
+    make_addresses(num_keys, keys);
+    bench_parallel_keys("addresses", keys);
+
+    /*
+     * The runs of a small, sparse trie often find no place among the
+     * elements in use, and are appended to the end of the double array.
+     */
+    make_probes(760, keys);
+    bench_parallel_keys("probes", keys);
+    return 0;
+#else
+    fprintf(stderr, "parallel build requires C++11 threads\n");
+    return 1;
+#endif
+}
+
+/* Writes the keys in random order as lines of a key, a tab, and a value. */
+static int write_tsv(const char *path, size_t num_keys, bool addresses)
+{
+    vector<string> keys;
+    if (addresses) {
+        make_addresses(num_keys, keys);
+    } else {
+        make_keys(num_keys, keys);
+    }
+    vector<size_t> order(keys.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    uint32_t seed = 2468;
+    for (size_t i = order.size(); 1 < i; --i) {
+        std::swap(order[i - 1], order[xorshift(seed) % i]);
+    }
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL) {
+        return 1;
+    }
+    for (size_t i = 0; i < order.size(); ++i) {
+        fprintf(fp, "%s\t%u\n", keys[order[i]].c_str(), (unsigned)order[i]);
+    }
+    fclose(fp);
+    return 0;
+}
+
+static bool record_less(const record_type &a, const record_type &b)
+{
+    return a.key < b.key;
+}
+
+/* Builds a trie as LanguageModel::build did: all records in memory. */
+static int build_in_memory(const char *path, size_t)
+{
+    std::ifstream ifs(path);
+    vector<record_type> records;
+    string line;
+    while (std::getline(ifs, line)) {
+        size_t tab = line.find('\t');
+        record_type record;
+        record.key = line.substr(0, tab);
+        record.value = (uint32_t)atol(line.c_str() + tab + 1);
+        records.push_back(record);
+    }
+    std::sort(records.begin(), records.end(), record_less);
+    builder_type builder;
+    double t0 = now();
+    builder.build(&records[0], &records[0] + records.size());
+    printf("build = %.2f sec, elements = %zu, ", now() - t0,
+            (size_t)builder.stat().da_num_total);
+    return 0;
+}
+
+typedef dastrie::builder<dastrie::key_view, uint32_t> view_builder_type;
+typedef view_builder_type::record_type view_record_type;
+
+static bool view_record_less(const view_record_type &a, const view_record_type &b)
+{
+    return a.key < b.key;
+}
+
+/* Builds a trie from the file read into one buffer, with records referring
+ * to the keys in the buffer. */
+static int build_from_blob(const char *path, size_t)
+{
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return 1;
+    }
+    fseek(fp, 0, SEEK_END);
+    vector<char> blob(ftell(fp) + 1);
+    rewind(fp);
+    size_t size = fread(&blob[0], 1, blob.size() - 1, fp);
+    fclose(fp);
+    blob[size] = '\0';
+
+    size_t num_lines = 0;
+    for (const char *p = &blob[0]; (p = strchr(p, '\n')) != NULL; ++p) {
+        ++num_lines;
+    }
+    vector<view_record_type> records;
+    records.reserve(num_lines);
+    for (char *p = &blob[0], *end = p + size; p < end;) {
+        char *tab = (char *)memchr(p, '\t', end - p);
+        char *eol = (char *)memchr(p, '\n', end - p);
+        if (tab == NULL || eol == NULL) {
+            break;
+        }
+        view_record_type record;
+        record.key = dastrie::key_view(p, tab - p);
+        record.value = (uint32_t)atol(tab + 1);
+        records.push_back(record);
+        p = eol + 1;
+    }
+    std::sort(records.begin(), records.end(), view_record_less);
+    view_builder_type builder;
+    double t0 = now();
+    builder.build(&records[0], &records[0] + records.size());
+    printf("build = %.2f sec, elements = %zu, ", now() - t0,
+            (size_t)builder.stat().da_num_total);
+    return 0;
+}
+
+/* Builds a trie from records sorted in runs on disk. */
+static int build_streaming(const char *path, size_t budget)
+{
+    std::ifstream ifs(path);
+    dastrie::record_sorter<uint32_t> sorter(budget);
+    sorter.read(ifs);
+    builder_type builder;
+    double t0 = now();
+    builder.build_stream(sorter);
+    printf("build = %.2f sec, elements = %zu, runs = %zu, ", now() - t0,
+            (size_t)builder.stat().da_num_total, sorter.runs());
+    return 0;
+}
+
+/* Runs a build in a child process to measure its peak RSS separately. */
+static void run_build(const char *name, const char *path,
+        int (*build)(const char *, size_t), size_t budget)
+{
+    printf("%-11s ", name);
+    fflush(stdout);
+    double t0 = now();
+#if defined(__linux__)
+    pid_t pid = fork();
+    if (pid == 0) {
+        int ret = build(path, budget);
+        fflush(stdout);
+        _exit(ret);
+    }
+    int status;
+    struct rusage usage;
+    wait4(pid, &status, 0, &usage);
+    printf("total = %.2f sec, peak RSS = %.1f MB\n", now() - t0,
+            usage.ru_maxrss / 1024.);
+#else
+    build(path, budget);
+    printf("total = %.2f sec\n", now() - t0);
+#endif
+}
+
+/* Writes an unsorted file of keys in a child so that they do not count in
+ * the RSS of the builds. */
+static int make_tsv(const char *path, size_t num_keys, bool addresses = false)
+{
+#if defined(__linux__)
+    pid_t pid = fork();
+    if (pid == 0) {
+        _exit(write_tsv(path, num_keys, addresses));
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    return (WIFEXITED(status) && WEXITSTATUS(status) == 0) ? 0 : 1;
+#else
+    return write_tsv(path, num_keys, addresses);
+#endif
+}
+
+static int bench_stream(size_t num_keys)
+{
+    const char *path = "dastrie_bench.tsv";
+    if (make_tsv(path, num_keys) != 0) {
+        return 1;
+    }
+    printf("keys = %zu (unsorted)\n", num_keys);
+    run_build("in-memory", path, build_in_memory, 0);
+    run_build("stream 64M", path, build_streaming, 64 << 20);
+    run_build("stream 16M", path, build_streaming, 16 << 20);
+    run_build("stream 4M", path, build_streaming, 4 << 20);
+    remove(path);
+    return 0;
+}
+
+static int bench_arena(size_t num_keys)
+{
+    const char *path = "dastrie_bench.tsv";
+    for (int addresses = 0; addresses < 2; ++addresses) {
+        if (make_tsv(path, num_keys, addresses != 0) != 0) {
+            return 1;
+        }
+        printf("%s: keys = %zu (unsorted)\n", addresses ? "addresses" : "words",
+                num_keys);
+        run_build("std::string", path, build_in_memory, 0);
+        run_build("key_view", path, build_from_blob, 0);
+    }
+    remove(path);
+    return 0;
+}
+
+/* Adds new words to a trie in place, as a rebuild would do at once. */
+static int bench_insert(size_t num_keys)
+{
+    typedef dastrie::dynamic_trie<uint32_t> dynamic_type;
+    const size_t num_new = 10000;
+
+    vector<string> keys, words;
+    make_keys(num_keys, keys);
+    make_keys(num_new * 2, words, 999);
+    vector<string> hot;
+    for (size_t i = 0; i < words.size() && hot.size() < num_new; ++i) {
+        if (!std::binary_search(keys.begin(), keys.end(), words[i])) {
+            hot.push_back(words[i]);
+        }
+    }
+    uint32_t seed = 4242;
+    for (size_t i = hot.size(); 1 < i; --i) {
+        std::swap(hot[i-1], hot[xorshift(seed) % i]);
+    }
+
+    trie_type trie;
+    builder_type builder;
+    build_trie(keys, trie, builder);
+    std::stringstream ss;
+    builder.write(ss);
+    string image = ss.str();
+
+    dynamic_type dyn;
+    double t0 = now();
+    dyn.assign(image.data(), image.size());
+    double t1 = now();
+    printf("keys = %zu, load = %.1f ms, elements = %zu\n",
+            keys.size(), (t1 - t0) * 1e3, (size_t)builder.stat().da_num_total);
+
+    double worst = 0.;
+    t0 = now();
+    for (size_t i = 0; i < hot.size(); ++i) {
+        double s = now();
+        dyn.insert(hot[i], (uint32_t)(keys.size() + i));
+        worst = std::max(worst, now() - s);
+    }
+    t1 = now();
+    printf("insert %zu new keys: %.2f us/key (worst %.1f us), total %.1f ms\n",
+            hot.size(), (t1 - t0) * 1e6 / hot.size(), worst * 1e6,
+            (t1 - t0) * 1e3);
+
+    /* Rebuilding the trie is the alternative to updating it. */
+    vector<string> all(keys);
+    all.insert(all.end(), hot.begin(), hot.end());
+    std::sort(all.begin(), all.end());
+    trie_type rebuilt;
+    builder_type rebuilder;
+    t0 = now();
+    build_trie(all, rebuilt, rebuilder);
+    t1 = now();
+    printf("rebuild %zu keys: %.1f ms, elements = %zu\n",
+            all.size(), (t1 - t0) * 1e3,
+            (size_t)rebuilder.stat().da_num_total);
+
+    vector<string> queries;
+    for (size_t i = 0; i < 1000000; ++i) {
+        queries.push_back(all[xorshift(seed) % all.size()]);
+    }
+    uint64_t sum = 0;
+    uint32_t value;
+    t0 = now();
+    for (size_t i = 0; i < queries.size(); ++i) {
+        if (dyn.find(queries[i], value)) {
+            sum += value;
+        }
+    }
+    t1 = now();
+    for (size_t i = 0; i < queries.size(); ++i) {
+        if (rebuilt.find(queries[i], value)) {
+            sum += value;
+        }
+    }
+    double t2 = now();
+    printf("lookup %.1f ns (updated) vs %.1f ns (rebuilt) (checksum %llu)\n",
+            (t1 - t0) * 1e9 / queries.size(), (t2 - t1) * 1e9 / queries.size(),
+            (unsigned long long)sum);
+
+    /* Every key must be found with its value in both tries. */
+    std::map<string, uint32_t> expected;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        expected[keys[i]] = (uint32_t)i;
+    }
+    for (size_t i = 0; i < hot.size(); ++i) {
+        expected[hot[i]] = (uint32_t)(keys.size() + i);
+    }
+    size_t errors = 0;
+    for (size_t i = 0; i < all.size(); ++i) {
+        uint32_t v1 = 0, v2 = 0;
+        if (!dyn.find(all[i], v1) || v1 != expected[all[i]] ||
+                !rebuilt.find(all[i], v2) || v2 != (uint32_t)i) {
+            ++errors;
+        }
+    }
+
+    t0 = now();
+    for (size_t i = 0; i < hot.size(); ++i) {
+        dyn.erase(hot[i]);
+    }
+    t1 = now();
+    printf("erase %zu keys: %.2f us/key, size = %zu\n",
+            hot.size(), (t1 - t0) * 1e6 / hot.size(), (size_t)dyn.size());
+
+    /* The erased keys must miss, and the others must remain. */
+    for (size_t i = 0; i < hot.size(); ++i) {
+        if (dyn.in(hot[i])) {
+            ++errors;
+        }
+    }
+    for (size_t i = 0; i < keys.size(); ++i) {
+        uint32_t v = 0;
+        if (!dyn.find(keys[i], v) || v != (uint32_t)i) {
+            ++errors;
+        }
+    }
+    if (errors != 0 || dyn.size() != keys.size()) {
+        printf("verify: MISMATCH (%zu errors)\n", errors);
+        return 1;
+    }
+    printf("verify: ok\n");
+    return 0;
+}
+
+#if DASTRIE_HAS_THREADS
+static double time_overlay(const dastrie::overlay<trie_type> &ov,
+        const vector<string> &queries, uint64_t &sum)
+{
+    uint32_t value;
+    double t0 = now();
+    for (size_t i = 0; i < queries.size(); ++i) {
+        if (ov.find(queries[i], value)) {
+            sum += value;
+        }
+    }
+    return (now() - t0) * 1e9 / queries.size();
+}
+#endif
+
+/* Serves lookups from a snapshot with a delta of updates merged by a thread. */
+static int bench_overlay(size_t num_keys)
+{
+#if DASTRIE_HAS_THREADS
+    typedef dastrie::overlay<trie_type> overlay_type;
+    const size_t num_updates = 10000;
+
+    vector<string> keys, words;
+    make_keys(num_keys, keys);
+    make_keys(num_updates, words, 999);
+    trie_type *trie = new trie_type;
+    builder_type builder;
+    build_trie(keys, *trie, builder);
+    std::stringstream ss;
+    builder.write(ss);
+    trie->read(ss);
+    overlay_type::snapshot_ptr base(trie);
+    overlay_type ov(base);
+
+    vector<string> queries;
+    uint32_t seed = 4242;
+    for (size_t i = 0; i < 1000000; ++i) {
+        queries.push_back(keys[xorshift(seed) % keys.size()]);
+    }
+    uint64_t sum = 0;
+    uint32_t value;
+    double t0 = now();
+    for (size_t i = 0; i < queries.size(); ++i) {
+        if (trie->find(queries[i], value)) {
+            sum += value;
+        }
+    }
+    double plain = (now() - t0) * 1e9 / queries.size();
+    double empty = time_overlay(ov, queries, sum);
+
+    /*
+     * Updates of new words, existing keys, and tombstones. The latency is
+     * also reported for the updates just below the default threshold of
+     * overlay::start(), where the background merge begins.
+     */
+    const size_t threshold = 4096;
+    vector<double> near;
+    t0 = now();
+    for (size_t i = 0; i < words.size(); ++i) {
+        size_t pending = ov.pending();
+        double s = now();
+        if (i % 4 == 3) {
+            ov.erase(keys[xorshift(seed) % keys.size()]);
+        } else if (i % 4 == 2) {
+            ov.insert(keys[xorshift(seed) % keys.size()], (uint32_t)i);
+        } else {
+            ov.insert(words[i], (uint32_t)i);
+        }
+        if (threshold - 512 <= pending && pending < threshold) {
+            near.push_back((now() - s) * 1e6);
+        }
+    }
+    double update = (now() - t0) * 1e6 / words.size();
+    double loaded = time_overlay(ov, queries, sum);
+    printf("keys = %zu, lookup %.1f ns (trie), %.1f ns (empty delta), "
+            "%.1f ns (%zu updates)\n", keys.size(), plain, empty, loaded,
+            ov.pending());
+    printf("update %.2f us\n", update);
+    if (!near.empty()) {
+        double total = 0.;
+        for (size_t i = 0; i < near.size(); ++i) {
+            total += near[i];
+        }
+        std::sort(near.begin(), near.end());
+        printf("update below %zu pending: mean %.2f us, median %.2f us, "
+                "p99 %.2f us, max %.2f us\n", threshold,
+                total / near.size(), near[near.size() / 2],
+                near[near.size() * 99 / 100], near.back());
+    }
+
+    /* Merge in the background while a reader measures its latency. */
+    std::atomic<bool> done(false);
+    double worst = 0.;
+    size_t reads = 0;
+    std::thread reader([&]() {
+        size_t i = 0;
+        while (!done) {
+            double s = now();
+            uint32_t v;
+            if (ov.find(queries[i++ % queries.size()], v)) {
+                sum += v;
+            }
+            worst = std::max(worst, now() - s);
+            ++reads;
+        }
+    });
+    t0 = now();
+    ov.compact();
+    double merge = now() - t0;
+    done = true;
+    reader.join();
+    printf("merge %.1f ms (snapshot = %zu keys), reads during merge = %zu, "
+            "worst read %.1f us\n", merge * 1e3,
+            (size_t)ov.snapshot()->size(), reads, worst * 1e6);
+    printf("lookup after merge %.1f ns (checksum %llu)\n",
+            time_overlay(ov, queries, sum), (unsigned long long)sum);
+    return 0;
+#else
+    fprintf(stderr, "overlay requires C++11 threads\n");
+    return 1;
+#endif
+}
+
+/* Reloads a trie while readers pin its versions in a handle. */
+static int bench_reload(size_t num_keys)
+{
+#if DASTRIE_HAS_THREADS
+    typedef dastrie::versioned<trie_type> handle_type;
+    const size_t num_reloads = 20;
+
+    vector<string> keys;
+    make_keys(num_keys, keys);
+    trie_type trie;
+    builder_type builder;
+    build_trie(keys, trie, builder);
+    std::stringstream ss;
+    builder.write(ss);
+    string image = ss.str();
+
+    vector<string> queries;
+    uint32_t seed = 4242;
+    for (size_t i = 0; i < 1000000; ++i) {
+        queries.push_back(keys[xorshift(seed) % keys.size()]);
+    }
+
+    trie_type *first = new trie_type;
+    std::istringstream is0(image);
+    first->read(is0);
+    handle_type handle(first);
+
+    /* The cost of pinning a version, against a lock around each lookup. */
+    uint64_t sum = 0;
+    uint32_t value;
+    double t0 = now();
+    for (size_t i = 0; i < queries.size(); ++i) {
+        if (trie.find(queries[i], value)) {
+            sum += value;
+        }
+    }
+    double plain = (now() - t0) * 1e9 / queries.size();
+    t0 = now();
+    for (size_t i = 0; i < queries.size(); ++i) {
+        handle_type::guard g(handle);
+        if (g->find(queries[i], value)) {
+            sum += value;
+        }
+    }
+    double pinned = (now() - t0) * 1e9 / queries.size();
+    std::mutex mutex;
+    t0 = now();
+    for (size_t i = 0; i < queries.size(); ++i) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (trie.find(queries[i], value)) {
+            sum += value;
+        }
+    }
+    double locked = (now() - t0) * 1e9 / queries.size();
+    printf("keys = %zu, lookup %.1f ns (trie), %.1f ns (guard), "
+            "%.1f ns (mutex)\n", keys.size(), plain, pinned, locked);
+
+    /* Readers measure their latency while the trie is reloaded. */
+    const int num_readers = 2;
+    std::atomic<bool> done(false);
+    std::atomic<uint64_t> checksum(0);
+    double worst[num_readers] = {0.};
+    size_t reads[num_readers] = {0};
+    vector<std::thread> readers;
+    for (int r = 0; r < num_readers; ++r) {
+        readers.push_back(std::thread([&, r]() {
+            size_t i = r * 7919;
+            uint64_t s = 0;
+            while (!done) {
+                double t = now();
+                uint32_t v;
+                {
+                    handle_type::guard g(handle);
+                    if (g->find(queries[i++ % queries.size()], v)) {
+                        s += v;
+                    }
+                }
+                worst[r] = std::max(worst[r], now() - t);
+                ++reads[r];
+            }
+            checksum += s;
+        }));
+    }
+    double load = 0., publish = 0.;
+    for (size_t n = 0; n < num_reloads; ++n) {
+        t0 = now();
+        trie_type *next = new trie_type;
+        std::istringstream is(image);
+        next->read(is);
+        double t1 = now();
+        handle.publish(next);
+        handle.synchronize();
+        load += t1 - t0;
+        publish += now() - t1;
+    }
+    done = true;
+    for (int r = 0; r < num_readers; ++r) {
+        readers[r].join();
+    }
+    printf("reloads = %zu (load %.1f ms, publish %.1f us), reads = %zu, "
+            "worst read %.1f us (checksum %llu)\n", (size_t)handle.version(),
+            load * 1e3 / num_reloads, publish * 1e6 / num_reloads,
+            reads[0] + reads[1], std::max(worst[0], worst[1]) * 1e6,
+            (unsigned long long)(sum + checksum));
+    return 0;
+#else
+    fprintf(stderr, "reload requires C++11 threads\n");
+    return 1;
+#endif
+}
+
+/* Rejects missing keys with the Bloom filter before walking the trie. */
+static void bench_filter_keys(const char *name, const vector<string> &keys,
+        const vector<string> &words)
+{
+    const size_t num_queries = 1000000;
+
+    vector<string> misses;
+    for (size_t i = 0; i < words.size(); ++i) {
+        if (!std::binary_search(keys.begin(), keys.end(), words[i])) {
+            misses.push_back(words[i]);
+        }
+    }
+    uint32_t seed = 4242;
+    vector<size_t> hits(num_queries), others(num_queries);
+    for (size_t i = 0; i < num_queries; ++i) {
+        hits[i] = xorshift(seed) % keys.size();
+        others[i] = xorshift(seed) % misses.size();
+    }
+
+    trie_type trie;
+    builder_type builder;
+    build_trie(keys, trie, builder);
+    std::stringstream ss;
+    builder.write(ss);
+    string image = ss.str();
+    trie_type plain;
+    plain.assign(image.data(), image.size());
+
+    uint64_t sum = 0;
+    printf("%s: keys = %zu, misses = %zu\n", name, keys.size(), misses.size());
+    printf("none     %6.1f ns/hit  %6.1f ns/miss  %9.1f KB image\n",
+            time_lookups(plain, keys, hits, sum),
+            time_lookups(plain, misses, others, sum), image.size() / 1024.);
+
+    const double rates[] = {0.01, 0.001};
+    for (size_t r = 0; r < sizeof(rates) / sizeof(rates[0]); ++r) {
+        builder.annotate_filter(rates[r]);
+        std::stringstream fs;
+        builder.write(fs);
+        string fimage = fs.str();
+        trie_type filtered;
+        filtered.assign(fimage.data(), fimage.size());
+
+        /* The misses that pass the same filter. */
+        size_t n = dastrie::bloom_block::num_blocks(keys.size(), rates[r]);
+        vector<dastrie::bloom_block> filter(n);
+        for (size_t i = 0; i < keys.size(); ++i) {
+            uint64_t h = dastrie::bloom_block::hash(keys[i].data(), keys[i].size());
+            filter[dastrie::bloom_block::index(h, n)].insert(h);
+        }
+        size_t passed = 0;
+        for (size_t i = 0; i < misses.size(); ++i) {
+            uint64_t h = dastrie::bloom_block::hash(misses[i].data(), misses[i].size());
+            passed += filter[dastrie::bloom_block::index(h, n)].test(h);
+        }
+
+        printf("fp %.3f %6.1f ns/hit  %6.1f ns/miss  %9.1f KB image, "
+                "%.2f bytes/key, measured fp %.4f (checksum %llu)\n", rates[r],
+                time_lookups(filtered, keys, hits, sum),
+                time_lookups(filtered, misses, others, sum),
+                fimage.size() / 1024., (double)(fimage.size() - image.size()) / keys.size(),
+                (double)passed / misses.size(), (unsigned long long)sum);
+    }
+}
+
+static int bench_filter(size_t num_keys)
+{
+    vector<string> keys, words;
+    make_keys(num_keys, keys);
+    make_keys(num_keys, words, 999);
+    bench_filter_keys("words", keys, words);
+
+    make_addresses(num_keys, keys);
+    make_addresses(num_keys, words, 999);
+    bench_filter_keys("addresses", keys, words);
+    return 0;
+}
+
+/* Normalizes a query into a copy as python/strutils.py d2s() and lower()
+ * do, the way callers did before normalizing look-ups. */
+static string normalize_copy(const string &str)
+{
+    string ret;
+    for (size_t i = 0; i < str.size(); ) {
+        uint8_t c = (uint8_t)str[i];
+        uint8_t c1 = (i + 2 < str.size()) ? (uint8_t)str[i + 1] : 0;
+        uint8_t c2 = (i + 2 < str.size()) ? (uint8_t)str[i + 2] : 0;
+        if (c == 0xEF && c1 == 0xBC && 0x81 <= c2 && c2 <= 0xBF) {
+            c = c2 - 0x60;
+            i += 3;
+        } else if (c == 0xEF && c1 == 0xBD && 0x80 <= c2 && c2 <= 0x9E) {
+            c = c2 - 0x20;
+            i += 3;
+        } else if (c == 0xE3 && c1 == 0x80 && c2 == 0x80) {
+            c = ' ';
+            i += 3;
+        } else {
+            ++i;
+        }
+        ret += (char)(('A' <= c && c <= 'Z') ? c - 'A' + 'a' : c);
+    }
+    return ret;
+}
+
+/* Looks up mixed-case, full-width queries with and without a copy. */
+static int bench_normalize(size_t num_keys)
+{
+    const size_t num_queries = 1000000;
+
+    /* Words with a lowercase ASCII brand or model name, as in queries. */
+    vector<string> keys;
+    make_keys(num_keys, keys);
+    uint32_t seed = 2024;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        string name;
+        int len = 2 + xorshift(seed) % 5;
+        for (int j = 0; j < len; ++j) {
+            uint32_t r = xorshift(seed) % 36;
+            name += (char)(r < 26 ? 'a' + r : '0' + r - 26);
+        }
+        keys[i] = (i % 2) ? name + keys[i] : keys[i] + name;
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+    /* Queries type a third of the letters in upper case, and a third of
+     * the ASCII characters in full width. */
+    vector<string> queries(num_queries), folded(num_queries);
+    for (size_t i = 0; i < num_queries; ++i) {
+        const string &key = keys[xorshift(seed) % keys.size()];
+        string &query = queries[i];
+        for (size_t j = 0; j < key.size(); ++j) {
+            uint8_t c = (uint8_t)key[j];
+            uint32_t r = xorshift(seed) % 3;
+            if (c < 0x80 && r == 0) {
+                append_utf8(query, 0xFF01 + (c - 0x21));
+            } else if ('a' <= c && c <= 'z' && r == 1) {
+                query += (char)(c - 'a' + 'A');
+            } else {
+                query += (char)c;
+            }
+        }
+        folded[i] = normalize_copy(query);
+    }
+
+    trie_type trie;
+    builder_type builder;
+    build_trie(keys, trie, builder);
+    dastrie::text_normalizer norm;
+
+    uint64_t sum = 0;
+    size_t found = 0;
+    double best[3] = {0., 0., 0.};
+    for (int round = 0; round < 3; ++round) {
+        double t[3];
+        uint32_t value = 0;
+        double t0 = now();
+        for (size_t i = 0; i < num_queries; ++i) {
+            if (trie.find(folded[i], value)) {
+                sum += value;
+            }
+        }
+        t[0] = now() - t0;
+        t0 = now();
+        for (size_t i = 0; i < num_queries; ++i) {
+            if (trie.find(normalize_copy(queries[i]), value)) {
+                sum += value;
+            }
+        }
+        t[1] = now() - t0;
+        t0 = now();
+        found = 0;
+        for (size_t i = 0; i < num_queries; ++i) {
+            if (trie.find(queries[i], value, norm)) {
+                sum += value;
+                ++found;
+            }
+        }
+        t[2] = now() - t0;
+        for (int k = 0; k < 3; ++k) {
+            t[k] *= 1e9 / num_queries;
+            if (round == 0 || t[k] < best[k]) {
+                best[k] = t[k];
+            }
+        }
+    }
+
+    printf("keys = %zu, queries = %zu, found = %zu\n",
+            keys.size(), num_queries, found);
+    printf("pre-normalized find    %6.1f ns\n", best[0]);
+    printf("normalize copy + find  %6.1f ns\n", best[1]);
+    printf("find with normalizer   %6.1f ns (checksum %llu)\n",
+            best[2], (unsigned long long)sum);
+    return 0;
+}
+
+/* Reads a byte as a character, as the byte-wise trie does. */
+struct byte_alphabet
+{
+    static uint32_t next(const char *&p, const char *)
+    {
+        return (uint8_t)*p++;
+    }
+};
+
+/* Counts the transitions from the root to the leaf of each key, i.e., the
+ * characters that the key shares with its neighbours plus one. */
+template <class alphabet>
+static double mean_depth(const vector<string> &keys)
+{
+    uint64_t sum = 0;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        size_t depth = 0;
+        for (size_t j = (i ? i - 1 : i); j <= i + 1 && j < keys.size(); ++j) {
+            if (j == i) {
+                continue;
+            }
+            const char *p = keys[i].data(), *p_end = p + keys[i].size();
+            const char *q = keys[j].data(), *q_end = q + keys[j].size();
+            size_t n = 0;
+            while (p < p_end && q < q_end &&
+                    alphabet::next(p, p_end) == alphabet::next(q, q_end)) {
+                ++n;
+            }
+            depth = std::max(depth, n);
+        }
+        sum += depth + 1;
+    }
+    return (double)sum / keys.size();
+}
+
+/* Times look-ups of random keys on a byte-wise or a wide trie. */
+template <class trie_tmpl>
+static double time_find(const trie_tmpl &trie, const vector<string> &keys,
+        uint64_t &sum)
+{
+    const size_t num_queries = 1000000;
+    vector<size_t> order(num_queries);
+    uint32_t seed = 4242;
+    for (size_t i = 0; i < num_queries; ++i) {
+        order[i] = xorshift(seed) % keys.size();
+    }
+    double best = 0.;
+    for (int round = 0; round < 3; ++round) {
+        uint32_t value = 0;
+        double t0 = now();
+        for (size_t i = 0; i < num_queries; ++i) {
+            if (trie.find(keys[order[i]], value)) {
+                sum += value;
+            }
+        }
+        double t = (now() - t0) * 1e9 / num_queries;
+        if (round == 0 || t < best) {
+            best = t;
+        }
+    }
+    return best;
+}
+
+template <class alphabet>
+static void bench_wide_keys(const char *name, const vector<string> &keys)
+{
+    typedef dastrie::wide_builder<uint32_t, alphabet> wide_builder_type;
+    typedef dastrie::wide_trie<uint32_t, alphabet> wide_trie_type;
+
+    vector<record_type> records(keys.size());
+    vector<typename wide_builder_type::record_type> wide_records(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        records[i].key = wide_records[i].key = keys[i];
+        records[i].value = wide_records[i].value = (uint32_t)i;
+    }
+
+    builder_type builder;
+    double t0 = now();
+    builder.build(&records[0], &records[0] + records.size());
+    double byte_sec = now() - t0;
+    std::stringstream ss;
+    builder.write(ss);
+    string image = ss.str();
+    trie_type trie;
+    trie.assign(image.data(), image.size());
+
+    wide_builder_type wide_builder;
+    t0 = now();
+    wide_builder.build(&wide_records[0], &wide_records[0] + wide_records.size());
+    double wide_sec = now() - t0;
+    std::stringstream ws;
+    wide_builder.write(ws);
+    string wide_image = ws.str();
+    wide_trie_type wide;
+    wide.assign(wide_image.data(), wide_image.size());
+
+    uint64_t sum = 0;
+    printf("%s: keys = %zu\n", name, keys.size());
+    printf("byte   depth %5.2f  elements %9zu  usage %.3f  image %9.1f KB  "
+            "build %.2f sec  lookup %6.1f ns\n",
+            mean_depth<byte_alphabet>(keys), (size_t)builder.stat().da_num_total,
+            builder.stat().da_usage, image.size() / 1024., byte_sec,
+            time_find(trie, keys, sum));
+    printf("wide   depth %5.2f  elements %9zu  usage %.3f  image %9.1f KB  "
+            "build %.2f sec  lookup %6.1f ns (checksum %llu)\n",
+            mean_depth<alphabet>(keys), (size_t)wide_builder.stat().da_num_total,
+            wide_builder.stat().da_usage, wide_image.size() / 1024., wide_sec,
+            time_find(wide, keys, sum), (unsigned long long)sum);
+}
+
+/* Encodes the words of make_keys() in GBK; the 3500 characters map to the
+ * level-1 hanzi of GB2312 in order. */
+static void to_gbk(const vector<string> &keys, vector<string> &gbk)
+{
+    gbk.clear();
+    for (size_t i = 0; i < keys.size(); ++i) {
+        string key;
+        const char *p = keys[i].data(), *last = p + keys[i].size();
+        while (p < last) {
+            uint32_t unit = dastrie::utf8_alphabet::next(p, last);
+            uint32_t k = (((unit >> 16) & 0x0F) << 12 | ((unit >> 8) & 0x3F) << 6 |
+                    (unit & 0x3F)) - 0x4E00;
+            key += (char)(0xB0 + k / 94);
+            key += (char)(0xA1 + k % 94);
+        }
+        gbk.push_back(key);
+    }
+    std::sort(gbk.begin(), gbk.end());
+}
+
+/* Generates n distinct random Chinese words whose characters follow
+ * Zipf(1), as they do in real text; the frequency rank of a character is
+ * independent of its code point. */
+static void make_zipf_words(size_t n, vector<string> &keys, uint32_t seed = 4321)
+{
+    const uint32_t num_chars = 3500;
+    vector<uint32_t> chars(num_chars);
+    vector<double> cdf(num_chars);
+    double total = 0.;
+    for (uint32_t i = 0; i < num_chars; ++i) {
+        chars[i] = 0x4E00 + i;
+        total += 1.0 / (1 + i);
+        cdf[i] = total;
+    }
+    for (uint32_t i = num_chars; 1 < i; --i) {
+        std::swap(chars[i - 1], chars[xorshift(seed) % i]);
+    }
+    keys.clear();
+    while (keys.size() < n) {
+        size_t need = n - keys.size();
+        for (size_t i = 0; i < need; ++i) {
+            string key;
+            int len = 2 + xorshift(seed) % 3;
+            for (int j = 0; j < len; ++j) {
+                double r = total * (xorshift(seed) / 4294967296.0);
+                size_t k = std::lower_bound(cdf.begin(), cdf.end(), r) - cdf.begin();
+                append_utf8(key, chars[std::min(k, (size_t)num_chars - 1)]);
+            }
+            keys.push_back(key);
+        }
+        std::sort(keys.begin(), keys.end());
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    }
+}
+
+/* Compares the byte-wise trie with the wide-alphabet trie. */
+static int bench_wide(size_t num_keys)
+{
+    vector<string> keys, gbk;
+    make_keys(num_keys, keys);
+    bench_wide_keys<dastrie::utf8_alphabet>("utf8", keys);
+    to_gbk(keys, gbk);
+    bench_wide_keys<dastrie::gbk_alphabet>("gbk", gbk);
+    make_zipf_words(num_keys, keys);
+    bench_wide_keys<dastrie::utf8_alphabet>("zipf", keys);
+    to_gbk(keys, gbk);
+    bench_wide_keys<dastrie::gbk_alphabet>("zipf-gbk", gbk);
+    make_addresses(num_keys, keys);
+    bench_wide_keys<dastrie::utf8_alphabet>("addresses", keys);
+    return 0;
+}
+
+#if defined(DASTRIE_HAS_MMAP) && defined(__linux__)
+/* The memory that this process holds, in kB: its proportional share of
+   anonymous memory and of shared memory objects. */
+static long held_kb()
+{
+    std::ifstream ifs("/proc/self/smaps_rollup");
+    string line;
+    long held = 0;
+    while (std::getline(ifs, line)) {
+        if (line.compare(0, 9, "Pss_Anon:") == 0) {
+            held += atol(line.c_str() + 9);
+        } else if (line.compare(0, 10, "Pss_Shmem:") == 0) {
+            held += atol(line.c_str() + 10);
+        }
+    }
+    return held;
+}
+
+/* Loads the image privately or from a shared image after start, reports
+   the memory that it holds at measure, when every process holds the image,
+   and exits at finish, when every process has reported. */
+static bool run_shm_proc(const char *name, const char *path,
+        const vector<string> &queries, bool shared, int start, int measure,
+        int result, int finish)
+{
+    char c = 0;
+    if (read(start, &c, 1) != 1) {
+        return false;
+    }
+    long held = held_kb();
+    double t0 = now();
+    trie_type trie;
+    dastrie::shared_image image;
+    bool ok;
+    if (shared) {
+        ok = image.attach_file(name, path) &&
+            trie.assign(image.data(), image.size()) != 0;
+    } else {
+        std::ifstream ifs(path, std::ios::in | std::ios::binary);
+        ok = trie.read(ifs) != 0;
+    }
+    double load = now() - t0;
+    uint64_t sum = 0;
+    uint32_t value;
+    for (size_t i = 0; ok && i < queries.size(); ++i) {
+        if (trie.find(queries[i], value)) {
+            sum += value;
+        }
+    }
+    if (write(result, &c, 1) != 1 || read(measure, &c, 1) != 1) {
+        return false;
+    }
+    double r[4] = {ok && sum != 0 ? 1. : 0., load, image.created() ? 1. : 0.,
+        (double)(held_kb() - held)};
+    if (write(result, r, sizeof(r)) != (ssize_t)sizeof(r)) {
+        return false;
+    }
+    return read(finish, &c, 1) == 1;
+}
+
+/* Writes a byte for each process to a pipe. */
+static void signal_procs(int fd, int num_procs)
+{
+    char c = 0;
+    for (int n = 0; n < num_procs; ++n) {
+        if (write(fd, &c, 1) != 1) {
+            break;
+        }
+    }
+}
+
+static void bench_shm_procs(const char *name, const char *path,
+        const vector<string> &queries, int num_procs, bool shared)
+{
+    int start[2], measure[2], result[2], finish[2];
+    if (pipe(start) != 0 || pipe(measure) != 0 || pipe(result) != 0 ||
+            pipe(finish) != 0) {
+        perror("pipe");
+        return;
+    }
+    for (int n = 0; n < num_procs; ++n) {
+        if (fork() == 0) {
+            /* Returns before _exit() so that the image is detached. */
+            _exit(run_shm_proc(name, path, queries, shared, start[0],
+                        measure[0], result[1], finish[0]) ? 0 : 1);
+        }
+    }
+
+    signal_procs(start[1], num_procs);
+    char c;
+    for (int n = 0; n < num_procs; ++n) {
+        if (read(result[0], &c, 1) != 1) {
+            break;
+        }
+    }
+    /* Every process holds the image now. */
+    signal_procs(measure[1], num_procs);
+    double first = 0., rest = 0., held = 0.;
+    int failed = 0, filled = 0;
+    for (int n = 0; n < num_procs; ++n) {
+        double r[4];
+        if (read(result[0], r, sizeof(r)) != (ssize_t)sizeof(r)) {
+            ++failed;
+            continue;
+        }
+        failed += (r[0] == 0.);
+        held += r[3];
+        if (r[2] != 0.) {
+            first = r[1];
+            ++filled;
+        } else {
+            rest += r[1];
+        }
+    }
+    signal_procs(finish[1], num_procs);
+    int status;
+    while (wait(&status) > 0) {
+        failed += !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+    }
+    close(start[0]); close(start[1]);
+    close(measure[0]); close(measure[1]);
+    close(result[0]); close(result[1]);
+    close(finish[0]); close(finish[1]);
+
+    /* The others wait for the process that fills the image. */
+    int others = std::max(1, num_procs - filled);
+    if (shared) {
+        printf("  shared:  %2d procs, +%.1f MB held, fill %.1f ms, "
+                "attach %.1f ms, failed %d\n", num_procs, held / 1024.,
+                first * 1e3, rest * 1e3 / others, failed);
+    } else {
+        printf("  private: %2d procs, +%.1f MB held, read %.1f ms, "
+                "failed %d\n", num_procs, held / 1024., rest * 1e3 / others,
+                failed);
+    }
+}
+
+/* One copy of an image per host rather than per process. */
+static int bench_shm(size_t num_keys)
+{
+    const char *path = "/tmp/dastrie_bench_shm.db";
+    const char *name = "/dastrie_bench_shm";
+
+    vector<string> keys;
+    make_keys(num_keys, keys);
+    trie_type trie;
+    builder_type builder;
+    build_trie(keys, trie, builder);
+    std::ofstream ofs(path, std::ios::out | std::ios::binary);
+    builder.write(ofs);
+    ofs.close();
+    struct stat st;
+    stat(path, &st);
+    size_t image_size = (size_t)st.st_size;
+
+    vector<string> queries;
+    uint32_t seed = 2468;
+    for (size_t i = 0; i < 200000; ++i) {
+        queries.push_back(keys[xorshift(seed) % keys.size()]);
+    }
+
+    printf("keys = %zu, image %.1f MB\n", keys.size(),
+            image_size / 1048576.);
+    const int procs[] = {1, 4, 16};
+    for (size_t i = 0; i < sizeof(procs) / sizeof(procs[0]); ++i) {
+        bench_shm_procs(name, path, queries, procs[i], false);
+        bench_shm_procs(name, path, queries, procs[i], true);
+    }
+
+    /* The last process has removed the name. */
+    string shm_path = string("/dev/shm") + name;
+    printf("%s %s\n", shm_path.c_str(),
+            stat(shm_path.c_str(), &st) == 0 ? "is left" : "is removed");
+    unlink(path);
+    return 0;
+}
+#else
+static int bench_shm(size_t)
+{
+    fprintf(stderr, "shm requires POSIX shared memory\n");
+    return 1;
+}
+#endif
+
+#ifdef DASTRIE_HAS_CONSTEXPR
+/* Stopwords of Chinese queries, as a tokenizer would check them. */
+static constexpr const char *stopwords[] = {
+    "\xe7\x9a\x84", "\xe4\xba\x86", "\xe5\x92\x8c", "\xe6\x98\xaf",
+    "\xe5\x9c\xa8", "\xe4\xb9\x9f", "\xe5\xb0\xb1", "\xe9\x83\xbd",
+    "\xe8\x80\x8c", "\xe5\x8f\x8a", "\xe4\xb8\x8e", "\xe7\x9d\x80",
+    "\xe6\x88\x96", "\xe4\xb8\xaa", "\xe6\x88\x91", "\xe4\xbd\xa0",
+    "\xe4\xbb\x96", "\xe5\xa5\xb9", "\xe5\xae\x83", "\xe8\xbf\x99",
+    "\xe9\x82\xa3", "\xe5\x90\x97", "\xe5\x91\xa2", "\xe5\x90\xa7",
+    "\xe5\x95\x8a", "\xe6\x80\x8e\xe4\xb9\x88", "\xe4\xbb\x80\xe4\xb9\x88",
+    "\xe5\x93\xaa\xe9\x87\x8c", "\xe5\x8f\xaf\xe4\xbb\xa5",
+    "\xe6\xb2\xa1\xe6\x9c\x89", "the", "a", "an", "of", "and", "to", "in",
+    "is", "for", "on", "with", " ", "\t", ",", ".", "-", "/", "\x01",
+};
+static constexpr size_t num_stopwords = sizeof(stopwords) / sizeof(stopwords[0]);
+static constexpr dastrie::static_trie<uint32_t, num_stopwords,
+       dastrie::static_trie_capacity(stopwords)> stopword_set(stopwords);
+static_assert(stopword_set.in("\xe7\x9a\x84"), "a stopword is missing");
+
+/* A compile-time trie against a loaded one for a small keyword set. */
+static int bench_static(size_t num_keys)
+{
+    vector<string> words(stopwords, stopwords + num_stopwords);
+    std::sort(words.begin(), words.end());
+    vector<record_type> records(words.size());
+    for (size_t i = 0; i < words.size(); ++i) {
+        records[i].key = words[i];
+        records[i].value = (uint32_t)i;
+    }
+    builder_type builder;
+    builder.build(&records[0], &records[0] + records.size());
+    std::stringstream ss;
+    builder.write(ss);
+    trie_type trie;
+    trie.read(ss);
+
+    /* Tokens of queries: a third are stopwords, the others are words. */
+    vector<string> keys, tokens;
+    make_keys(num_keys, keys);
+    uint32_t seed = 1357;
+    for (size_t i = 0; i < 2000000; ++i) {
+        uint32_t r = xorshift(seed);
+        tokens.push_back((r % 3 == 0) ? words[r / 3 % words.size()] :
+                keys[r / 3 % keys.size()]);
+    }
+
+    uint32_t value;
+    size_t hits = 0, same = 0;
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        bool found = trie.in(tokens[i]);
+        same += (found == stopword_set.in(tokens[i].data(), tokens[i].size()));
+        hits += found;
+    }
+    for (int round = 0; round < 3; ++round) {
+        double t0 = now();
+        size_t n = 0;
+        for (size_t i = 0; i < tokens.size(); ++i) {
+            n += trie.find(tokens[i], value);
+        }
+        double loaded = (now() - t0) * 1e9 / tokens.size();
+        t0 = now();
+        for (size_t i = 0; i < tokens.size(); ++i) {
+            n += stopword_set.find(tokens[i].data(), tokens[i].size(), value);
+        }
+        double compiled = (now() - t0) * 1e9 / tokens.size();
+        printf("stopwords = %zu (%zu elements), tokens = %zu, hits = %zu, "
+                "same = %zu: %.1f ns (trie), %.1f ns (static_trie) [%zu]\n",
+                stopword_set.size(), stopword_set.num_elements(),
+                tokens.size(), hits, same, loaded, compiled, n);
+    }
+    return 0;
+}
+#else
+static int bench_static(size_t)
+{
+    fprintf(stderr, "static requires C++14\n");
+    return 1;
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+    string mode = (argc > 1) ? argv[1] : "lookup";
+    size_t num_keys = (argc > 2) ? (size_t)atol(argv[2]) : 200000;
+
+    if (mode == "lookup") {
+        return bench_lookup(num_keys);
+    } else if (mode == "batch") {
+        return bench_batch(num_keys);
+    } else if (mode == "scan") {
+        return bench_scan(num_keys);
+    } else if (mode == "predict") {
+        return bench_predict(num_keys);
+    } else if (mode == "match") {
+        return bench_match(num_keys);
+    } else if (mode == "fuzzy") {
+        return bench_fuzzy(num_keys);
+    } else if (mode == "zipf") {
+        return bench_zipf(num_keys);
+    } else if (mode == "layout") {
+        return bench_layout(num_keys);
+    } else if (mode == "tail") {
+        return bench_tail(num_keys);
+    } else if (mode == "rank") {
+        return bench_rank(num_keys);
+    } else if (mode == "build") {
+        return bench_build(num_keys);
+    } else if (mode == "parallel") {
+        return bench_parallel(num_keys);
+    } else if (mode == "stream") {
+        return bench_stream(num_keys);
+    } else if (mode == "arena") {
+        return bench_arena(num_keys);
+    } else if (mode == "insert") {
+        return bench_insert(num_keys);
+    } else if (mode == "overlay") {
+        return bench_overlay(num_keys);
+    } else if (mode == "reload") {
+        return bench_reload(num_keys);
+    } else if (mode == "filter") {
+        return bench_filter(num_keys);
+    } else if (mode == "normalize") {
+        return bench_normalize(num_keys);
+    } else if (mode == "wide") {
+        return bench_wide(num_keys);
+    } else if (mode == "shm") {
+        return bench_shm(num_keys);
+    } else if (mode == "static") {
+        return bench_static(num_keys);
+    }
+
+    fprintf(stderr, "unknown benchmark: %s\n", mode.c_str());
+    return 1;
+}